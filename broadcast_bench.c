@@ -0,0 +1,288 @@
+/******************************************************************************
+* FILE: broadcast_bench.c
+* DESCRIPTION:
+*  Cost of a condvar broadcast to N waiters that all take the mutex on
+*  their way out, as the watchers of pi_cv_cond_stress_3w_ft.c do. The
+*  waiters have distinct priorities (they wrap around past 80 of them)
+*  above the broadcaster's, and for every N the benchmark measures, from
+*  the broadcast:
+*
+*   first waiter	the first waiter running with the mutex held
+*   last waiter		the last one, when the whole herd is through
+*
+*  along with the context switches per broadcast and how many pairs of
+*  waiters took the mutex out of priority order. A broadcast that wakes
+*  everybody has each waiter preempt the broadcaster only to block on the
+*  mutex again; pi-requeue moves them onto the PI mutex instead, and the
+*  unlock hands it over one waiter at a time, highest priority first.
+*
+*  The broadcaster and the waiters all run on a single CPU.
+******************************************************************************/
+#define _GNU_SOURCE
+#include <sched.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "rt-app_utils.h"
+#include "stats.h"
+#include "libcv/dl_syscalls.h"
+#include "libcv/sync_backend.h"
+
+#define MAX_COUNTS	16
+#define MAX_WAITERS	256
+#define WAITER_PRIO	10	/* lowest waiter priority */
+#define NR_PRIOS	80
+#define BCAST_PRIO	5
+
+struct global_args_t {
+	int counts[MAX_COUNTS];	/* -n waiter counts to run */
+	int ncounts;
+	int iterations;		/* -i broadcasts per waiter count */
+	int cpu;		/* -C CPU everything runs on */
+	char *sync;		/* -B mutex/condvar backend */
+} global_args;
+
+static const char *opt_string = "n:i:C:B:";
+
+sync_mutex_t lock;
+sync_cond_t cv;
+
+/* Under lock */
+int generation, stop;
+int waiting;			/* waiters blocked on cv */
+int running;			/* waiters through since the broadcast */
+int order[MAX_WAITERS];		/* their priorities, in the order they ran */
+unsigned long long t_bcast, t_first, t_last;
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return timespec_to_nsec(&now);
+}
+
+static void pin_thread(int prio)
+{
+	struct sched_param param;
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(global_args.cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+		printf("pthread_setaffinity failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	param.sched_priority = prio;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+		printf("pthread_setschedparam failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void *waiter(void *d)
+{
+	long i = (long) d;
+	int prio = WAITER_PRIO + i % NR_PRIOS, gen = 0;
+
+	pin_thread(prio);
+
+	sync_mutex_lock(&lock);
+	for (;;) {
+		waiting++;
+		while (generation == gen)
+			sync_cond_wait(&cv, &lock);
+		gen = generation;
+		if (stop)
+			break;
+		t_last = now_nsec();
+		if (!running)
+			t_first = t_last;
+		order[running++] = prio;
+	}
+	sync_mutex_unlock(&lock);
+
+	pthread_exit(NULL);
+}
+
+/* Pairs of waiters where the lower priority one ran first */
+static unsigned long inversions(int n)
+{
+	unsigned long inv = 0;
+	int i, j;
+
+	for (i = 0; i < n; i++)
+		for (j = i + 1; j < n; j++)
+			inv += order[i] < order[j];
+
+	return inv;
+}
+
+/* A failed broadcast leaves the waiters asleep, and the numbers void */
+static void broadcast(void)
+{
+	int ret = sync_cond_broadcast(&cv);
+
+	if (ret) {
+		printf("broadcast failed: %s\n", strerror(ret));
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* Take lock once cond holds, polling: we are the lowest priority here */
+static void lock_when(int *var, int val)
+{
+	struct timespec t = usec_to_timespec(100);
+
+	sync_mutex_lock(&lock);
+	while (*var < val) {
+		sync_mutex_unlock(&lock);
+		nanosleep(&t, NULL);
+		sync_mutex_lock(&lock);
+	}
+}
+
+static void run_waiters(int n)
+{
+	pthread_t threads[MAX_WAITERS];
+	static hist_t first, last;
+	struct rusage ru_start, ru_end;
+	unsigned long inv = 0;
+	long csw = 0;
+	int i;
+
+	hist_init(&first);
+	hist_init(&last);
+	generation = stop = waiting = 0;
+	for (i = 0; i < n; i++)
+		pthread_create(&threads[i], NULL, waiter, (void *)(long)i);
+
+	for (i = 0; i < global_args.iterations; i++) {
+		lock_when(&waiting, n);
+		waiting = running = 0;
+		getrusage(RUSAGE_SELF, &ru_start);
+		t_bcast = now_nsec();
+		generation++;
+		broadcast();
+		sync_mutex_unlock(&lock);
+
+		/* they all run before we do, unless throttled */
+		lock_when(&running, n);
+		getrusage(RUSAGE_SELF, &ru_end);
+		hist_add(&first, t_first - t_bcast);
+		hist_add(&last, t_last - t_bcast);
+		inv += inversions(n);
+		csw += ru_end.ru_nvcsw - ru_start.ru_nvcsw +
+		       ru_end.ru_nivcsw - ru_start.ru_nivcsw;
+		sync_mutex_unlock(&lock);
+	}
+
+	sync_mutex_lock(&lock);
+	stop = 1;
+	generation++;
+	broadcast();
+	sync_mutex_unlock(&lock);
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+
+	printf("%d waiters, %d broadcasts\n", n, global_args.iterations);
+	hist_print(stdout, "  to first waiter", &first);
+	hist_print(stdout, "  to last waiter", &last);
+	printf("  %.1f context switches, %.1f pairs out of priority order"
+	       " per broadcast\n", (double)csw / global_args.iterations,
+	       (double)inv / global_args.iterations);
+	fflush(stdout);
+}
+
+static int parse_counts(const char *arg)
+{
+	const char *p = arg;
+	char *end;
+	long n;
+
+	global_args.ncounts = 0;
+	while (*p) {
+		n = strtol(p, &end, 10);
+		if (end == p || n < 1 || n > MAX_WAITERS ||
+		    global_args.ncounts == MAX_COUNTS)
+			return 1;
+		global_args.counts[global_args.ncounts++] = n;
+		p = end;
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return 1;
+	}
+
+	return !global_args.ncounts;
+}
+
+int main(int argc, char *argv[])
+{
+	cpu_set_t mask;
+	int i, opt;
+
+	parse_counts("2,4,8,16,32,64,128,256");
+	global_args.iterations = 200;
+	global_args.cpu = -1;
+
+	while ((opt = getopt(argc, argv, opt_string)) != -1) {
+		switch (opt) {
+		case 'n':
+			if (parse_counts(optarg)) {
+				printf("invalid waiter counts %s (1..%d)\n",
+				       optarg, MAX_WAITERS);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 'i':
+			global_args.iterations = atoi(optarg);
+			break;
+		case 'C':
+			global_args.cpu = atoi(optarg);
+			break;
+		case 'B':
+			global_args.sync = optarg;
+			break;
+		}
+	}
+
+	if (global_args.iterations < 1) {
+		printf("invalid iterations\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (sync_backend_setup(global_args.sync, 0)) {
+		printf("invalid sync backend %s, one of: %s\n",
+		       global_args.sync, sync_backend_names());
+		exit(EXIT_INV_COMMANDLINE);
+	}
+
+	/* first CPU we are allowed on, unless told otherwise */
+	if (global_args.cpu < 0) {
+		sched_getaffinity(0, sizeof(mask), &mask);
+		for (i = 0; i < CPU_SETSIZE && !CPU_ISSET(i, &mask); i++)
+			;
+		global_args.cpu = i;
+	}
+	pin_thread(BCAST_PRIO);
+
+	sync_mutex_init(&lock, 0);
+	sync_cond_init(&cv);
+
+	printf("Main(): %s sync backend, cpu %d\n", sync_backend->name,
+	       global_args.cpu);
+
+	for (i = 0; i < global_args.ncounts; i++)
+		run_waiters(global_args.counts[i]);
+
+	sync_cond_destroy(&cv);
+	sync_mutex_destroy(&lock);
+
+	return 0;
+}
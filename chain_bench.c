@@ -0,0 +1,429 @@
+/******************************************************************************
+* FILE: chain_bench.c
+* DESCRIPTION:
+*  Priority inversion through a blocking chain of growing depth, a deeper
+*  pi_cv_mutex_chain. A high priority waiter W blocks on edge 1, and the
+*  chain threads T1..TN (low priority) are linked by N edges, alternating:
+*
+*   odd edges	Tk-1 waits on condvar k, Tk is a registered helper of it
+*   even edges	Tk-1 blocks on PI mutex k, which Tk holds
+*
+*  The end of the chain, TN, is the only runnable chain thread, and a medium
+*  priority annoyer sharing the CPU is busy when W blocks. Unless the boost
+*  reaches TN through all the edges, TN only runs once the annoyer is done.
+*  Once TN runs, it works for -w usec and releases its edge, unwinding the
+*  chain back to W.
+*
+*  For every depth the report gives the time from W blocking to TN running
+*  (boost reach) and the time W stays blocked, plus the userspace boost
+*  engine counters with the uboost backends. Everything runs on a single CPU.
+******************************************************************************/
+#define _GNU_SOURCE
+#include <sched.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "rt-app_utils.h"
+#include "stats.h"
+#include "libcv/dl_syscalls.h"
+#include "libcv/sync_backend.h"
+#include "libcv/boost.h"
+
+#define MAX_DEPTH	64
+#define MAX_DEPTHS	16
+#define W_PRIO		95
+#define ANNOY_PRIO	93
+#define CHAIN_PRIO	90
+#define SETTLE		1000000L	/* nsec, chain blocks, annoyer starts */
+
+struct global_args_t {
+	int depths[MAX_DEPTHS];	/* -D chain depths to run */
+	int ndepths;
+	int iterations;		/* -i iterations per depth */
+	long work;		/* -w usec of work at the end of the chain */
+	long annoy;		/* -a usec the annoyer is busy */
+	int max_boost;		/* -m uboost propagation bound (edges) */
+	int cpu;		/* -C CPU everything runs on */
+	char *sync;		/* -B mutex/condvar backend */
+} global_args;
+
+static const char *opt_string = "D:i:w:a:m:C:B:";
+
+typedef struct {
+	sync_mutex_t mutex;	/* even edges */
+	sync_mutex_t lock;	/* odd edges, protects done */
+	sync_cond_t cond;
+	int done;
+} edge_t;
+
+edge_t edges[MAX_DEPTH + 1];
+int depth;
+volatile int w_blocked;
+volatile int quit;
+unsigned long long t_block, t_reach, t_wake;
+pthread_barrier_t setup, finish;
+
+/* Iteration gate, plain glibc so that it stays out of the measurements */
+pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t gate_cv = PTHREAD_COND_INITIALIZER;
+int gate_gen;
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return timespec_to_nsec(&now);
+}
+
+static inline void busywait(struct timespec *to)
+{
+	struct timespec t_step;
+
+	while (1) {
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t_step);
+		if (!timespec_lower(&t_step, to))
+			break;
+	}
+}
+
+static void busy_usec(long usec)
+{
+	struct timespec now, t;
+
+	t = usec_to_timespec(usec);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	t = timespec_add(&now, &t);
+	busywait(&t);
+}
+
+static void nap(long nsec)
+{
+	struct timespec t = { 0, nsec };
+
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &t, NULL);
+}
+
+static void setup_thread(int prio)
+{
+	struct sched_param param;
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(global_args.cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+		printf("pthread_setaffinity failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	param.sched_priority = prio;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+		printf("pthread_setschedparam failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void gate_wait(int *seen)
+{
+	pthread_mutex_lock(&gate_lock);
+	while (gate_gen == *seen)
+		pthread_cond_wait(&gate_cv, &gate_lock);
+	*seen = gate_gen;
+	pthread_mutex_unlock(&gate_lock);
+}
+
+static void gate_open(void)
+{
+	pthread_mutex_lock(&gate_lock);
+	gate_gen++;
+	pthread_cond_broadcast(&gate_cv);
+	pthread_mutex_unlock(&gate_lock);
+}
+
+static inline int cond_edge(int e)
+{
+	return e & 1;
+}
+
+/* Block on edge e until the thread at its end releases it */
+static void edge_block(int e)
+{
+	edge_t *ed = &edges[e];
+
+	if (cond_edge(e)) {
+		sync_mutex_lock(&ed->lock);
+		while (!ed->done)
+			sync_cond_wait(&ed->cond, &ed->lock);
+		sync_mutex_unlock(&ed->lock);
+	} else {
+		sync_mutex_lock(&ed->mutex);
+		sync_mutex_unlock(&ed->mutex);
+	}
+}
+
+static void edge_release(int e)
+{
+	edge_t *ed = &edges[e];
+
+	if (cond_edge(e)) {
+		sync_mutex_lock(&ed->lock);
+		ed->done = 1;
+		sync_cond_signal(&ed->cond);
+		sync_mutex_unlock(&ed->lock);
+	} else {
+		sync_mutex_unlock(&ed->mutex);
+	}
+}
+
+/* Tk, at the end of edge k */
+void *chain(void *d)
+{
+	long k = (long) d;
+	pid_t my_pid = gettid();
+	int seen = 0;
+
+	setup_thread(CHAIN_PRIO);
+
+	if (cond_edge(k) && sync_helpers_enabled())
+		sync_cond_helpers_add(&edges[k].cond, my_pid);
+
+	while (1) {
+		gate_wait(&seen);
+		if (quit)
+			break;
+
+		if (!cond_edge(k))
+			sync_mutex_lock(&edges[k].mutex);
+		pthread_barrier_wait(&setup);
+
+		if (k < depth) {
+			edge_block(k + 1);
+		} else {
+			/* let the rest of the chain block first */
+			while (!w_blocked)
+				sched_yield();
+			t_reach = now_nsec();
+			busy_usec(global_args.work);
+		}
+		edge_release(k);
+
+		pthread_barrier_wait(&finish);
+	}
+
+	if (cond_edge(k) && sync_helpers_enabled())
+		sync_cond_helpers_del(&edges[k].cond, my_pid);
+
+	pthread_exit(NULL);
+}
+
+void *waiter(void *d)
+{
+	int seen = 0;
+
+	setup_thread(W_PRIO);
+
+	while (1) {
+		gate_wait(&seen);
+		if (quit)
+			break;
+
+		pthread_barrier_wait(&setup);
+		nap(2 * SETTLE);
+		t_block = now_nsec();
+		w_blocked = 1;
+		edge_block(1);
+		t_wake = now_nsec();
+
+		pthread_barrier_wait(&finish);
+	}
+
+	pthread_exit(NULL);
+}
+
+void *annoyer(void *d)
+{
+	int seen = 0;
+
+	setup_thread(ANNOY_PRIO);
+
+	while (1) {
+		gate_wait(&seen);
+		if (quit)
+			break;
+
+		pthread_barrier_wait(&setup);
+		nap(SETTLE);
+		busy_usec(global_args.annoy);
+
+		pthread_barrier_wait(&finish);
+	}
+
+	pthread_exit(NULL);
+}
+
+static int parse_depths(const char *arg)
+{
+	const char *p = arg;
+	char *end;
+	long d;
+
+	global_args.ndepths = 0;
+	while (*p) {
+		d = strtol(p, &end, 10);
+		if (end == p || d < 1 || d > MAX_DEPTH ||
+		    global_args.ndepths == MAX_DEPTHS)
+			return 1;
+		global_args.depths[global_args.ndepths++] = d;
+		p = end;
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return 1;
+	}
+
+	return !global_args.ndepths;
+}
+
+static void run_depth(int n)
+{
+	pthread_t threads[MAX_DEPTH + 2];
+	static hist_t reach, blocked;
+	boost_stats_t bst;
+	int i, j, nthreads = 0;
+
+	depth = n;
+	quit = 0;
+	for (i = 1; i <= depth; i++) {
+		sync_mutex_init(&edges[i].mutex, 0);
+		sync_mutex_init(&edges[i].lock, 0);
+		sync_cond_init(&edges[i].cond);
+	}
+	pthread_barrier_init(&setup, NULL, depth + 3);
+	pthread_barrier_init(&finish, NULL, depth + 3);
+	hist_init(&reach);
+	hist_init(&blocked);
+
+	pthread_create(&threads[nthreads++], NULL, waiter, NULL);
+	pthread_create(&threads[nthreads++], NULL, annoyer, NULL);
+	for (i = 1; i <= depth; i++)
+		pthread_create(&threads[nthreads++], NULL, chain,
+			       (void *)(long)i);
+	/* helpers register before the first iteration */
+	nap(10 * SETTLE);
+	if (sync_backend->boost)
+		boost_reset_stats();
+
+	for (i = 0; i < global_args.iterations; i++) {
+		w_blocked = 0;
+		t_reach = 0;
+		for (j = 1; j <= depth; j++)
+			edges[j].done = 0;
+
+		gate_open();
+		pthread_barrier_wait(&setup);
+		pthread_barrier_wait(&finish);
+
+		hist_add(&reach, t_reach - t_block);
+		hist_add(&blocked, t_wake - t_block);
+	}
+
+	quit = 1;
+	gate_open();
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	printf("depth %d, %d iterations\n", depth, global_args.iterations);
+	hist_print(stdout, "  boost reach", &reach);
+	hist_print(stdout, "  waiter blocked", &blocked);
+	if (sync_backend->boost) {
+		boost_get_stats(&bst);
+		boost_stats_print(stdout, &bst);
+	}
+	fflush(stdout);
+
+	pthread_barrier_destroy(&setup);
+	pthread_barrier_destroy(&finish);
+	for (i = 1; i <= depth; i++) {
+		sync_mutex_destroy(&edges[i].mutex);
+		sync_mutex_destroy(&edges[i].lock);
+		sync_cond_destroy(&edges[i].cond);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	cpu_set_t mask;
+	int i, opt;
+
+	parse_depths("1,2,4,8,16,32");
+	global_args.iterations = 20;
+	global_args.work = 1000;
+	global_args.annoy = 50000;
+	global_args.max_boost = BOOST_MAX_DEPTH;
+	global_args.cpu = -1;
+
+	while ((opt = getopt(argc, argv, opt_string)) != -1) {
+		switch (opt) {
+		case 'D':
+			if (parse_depths(optarg)) {
+				printf("invalid depths %s (1..%d)\n", optarg,
+				       MAX_DEPTH);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 'i':
+			global_args.iterations = atoi(optarg);
+			break;
+		case 'w':
+			global_args.work = atol(optarg);
+			break;
+		case 'a':
+			global_args.annoy = atol(optarg);
+			break;
+		case 'm':
+			global_args.max_boost = atoi(optarg);
+			break;
+		case 'C':
+			global_args.cpu = atoi(optarg);
+			break;
+		case 'B':
+			global_args.sync = optarg;
+			break;
+		}
+	}
+
+	if (global_args.iterations < 1 || global_args.work < 0 ||
+	    global_args.annoy < 0 || global_args.max_boost < 1) {
+		printf("invalid iterations, work, annoyer or boost bound\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (sync_backend_setup(global_args.sync, 1)) {
+		printf("invalid sync backend %s, one of: %s\n",
+		       global_args.sync, sync_backend_names());
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	boost_set_max_depth(global_args.max_boost);
+
+	/* first CPU we are allowed on, unless told otherwise */
+	if (global_args.cpu < 0) {
+		sched_getaffinity(0, sizeof(mask), &mask);
+		for (i = 0; i < CPU_SETSIZE && !CPU_ISSET(i, &mask); i++)
+			;
+		global_args.cpu = i;
+	}
+	setup_thread(99);
+
+	printf("Main(): %s sync backend, cpu %d, %ld usec work, %ld usec"
+	       " annoyer, boost bound %d\n", sync_backend->name,
+	       global_args.cpu, global_args.work, global_args.annoy,
+	       global_args.max_boost);
+
+	for (i = 0; i < global_args.ndepths; i++)
+		run_depth(global_args.depths[i]);
+
+	return 0;
+}
@@ -0,0 +1,380 @@
+/******************************************************************************
+* FILE: group_bench.c
+* DESCRIPTION:
+*  Cost of helper groups. A group of N idle member threads helps on K
+*  condvars, and for every group size the benchmark measures:
+*
+*   attach/detach	one sync_group_attach()/detach() of the whole group
+*			to a condvar, against registering the N members one
+*			by one with sync_cond_helpers_add()/del()
+*   join/leave		one member added to or removed from the group while
+*			it is attached to all K condvars
+*   wait/wake		a high priority waiter blocking on one of the K
+*			condvars: time from its wait call to the (lower
+*			priority) signaler running, which includes boosting
+*			the whole group, and from the signal to the waiter
+*			running again, which includes deboosting it. The
+*			signaler takes the place of one member for this
+*			part, so that it is one of the helpers boosted
+*
+*  Past BOOST_MAX_HELPERS, the most helpers a condvar takes one by one, the
+*  per-thread side is skipped: only groups go that far.
+*
+*  The waiter, the signaler and the members all run on a single CPU.
+******************************************************************************/
+#define _GNU_SOURCE
+#include <sched.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "rt-app_utils.h"
+#include "stats.h"
+#include "libcv/dl_syscalls.h"
+#include "libcv/sync_backend.h"
+#include "libcv/boost.h"
+
+#define MAX_SIZES	16
+#define MAX_CONDS	SYNC_GROUP_CONDS
+#define WAITER_PRIO	95
+#define SIGNAL_PRIO	90
+
+struct global_args_t {
+	int sizes[MAX_SIZES];	/* -g group sizes to run */
+	int nsizes;
+	int nconds;		/* -k condvars the group helps on */
+	int iterations;		/* -i iterations per measurement */
+	int cpu;		/* -C CPU everything runs on */
+	char *sync;		/* -B mutex/condvar backend */
+} global_args;
+
+static const char *opt_string = "g:k:i:C:B:";
+
+sync_mutex_t lock;
+sync_cond_t conds[MAX_CONDS];
+sync_group_t group;
+pid_t members[SYNC_GROUP_MAX];
+pthread_barrier_t joined, release;
+
+/* Wait/wake handshake, under lock */
+int waiting, ready;
+unsigned long long t_call, t_signal;
+hist_t block, wake;
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return timespec_to_nsec(&now);
+}
+
+static void pin_thread(int prio)
+{
+	struct sched_param param;
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(global_args.cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+		printf("pthread_setaffinity failed\n");
+		exit(EXIT_FAILURE);
+	}
+	if (!prio)
+		return;
+
+	param.sched_priority = prio;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+		printf("pthread_setschedparam failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* An idle group member, SCHED_OTHER */
+void *member(void *d)
+{
+	long i = (long) d;
+
+	pin_thread(0);
+	members[i] = gettid();
+	pthread_barrier_wait(&joined);
+	pthread_barrier_wait(&release);
+
+	pthread_exit(NULL);
+}
+
+void *waiter(void *d)
+{
+	sync_cond_t *c = &conds[0];
+	int i;
+
+	pin_thread(WAITER_PRIO);
+
+	for (i = 0; i < global_args.iterations; i++) {
+		sync_mutex_lock(&lock);
+		waiting = 1;
+		t_call = now_nsec();
+		while (!ready)
+			sync_cond_wait(c, &lock);
+		hist_add(&wake, now_nsec() - t_signal);
+		ready = 0;
+		sync_mutex_unlock(&lock);
+	}
+
+	pthread_exit(NULL);
+}
+
+/* Signaler side, the calling thread, until the waiter is done */
+static void signaler(void)
+{
+	unsigned long long t_run;
+	int i = 0;
+
+	while (i < global_args.iterations) {
+		sync_mutex_lock(&lock);
+		if (!waiting) {
+			sync_mutex_unlock(&lock);
+			sched_yield();
+			continue;
+		}
+		t_run = now_nsec();
+		hist_add(&block, t_run - t_call);
+		waiting = 0;
+		ready = 1;
+		t_signal = now_nsec();
+		sync_cond_signal(&conds[0]);
+		sync_mutex_unlock(&lock);
+		i++;
+	}
+}
+
+static int group_attach_all(int n)
+{
+	int i, failed = 0;
+
+	for (i = 0; i < n; i++)
+		failed += !!sync_group_attach(&group, &conds[i]);
+
+	return failed;
+}
+
+static void group_detach_all(int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		sync_group_detach(&group, &conds[i]);
+}
+
+static void run_size(int size)
+{
+	pthread_t threads[SYNC_GROUP_MAX + 1];
+	static hist_t attach, detach, add, del, join, leave;
+	unsigned long long t;
+	boost_stats_t bst;
+	pthread_t w;
+	int i, j, failed = 0, gfailed = 0;
+
+	pthread_barrier_init(&joined, NULL, size + 1);
+	pthread_barrier_init(&release, NULL, size + 1);
+	for (i = 0; i < size; i++)
+		pthread_create(&threads[i], NULL, member, (void *)(long)i);
+	pthread_barrier_wait(&joined);
+
+	hist_init(&attach);
+	hist_init(&detach);
+	hist_init(&add);
+	hist_init(&del);
+	hist_init(&join);
+	hist_init(&leave);
+	hist_init(&block);
+	hist_init(&wake);
+
+	sync_group_init(&group);
+	for (i = 0; i < size; i++)
+		sync_group_add(&group, members[i]);
+
+	/* the whole group on one condvar, as one operation */
+	for (i = 0; i < global_args.iterations; i++) {
+		t = now_nsec();
+		gfailed += !!sync_group_attach(&group, &conds[0]);
+		hist_add(&attach, now_nsec() - t);
+		t = now_nsec();
+		sync_group_detach(&group, &conds[0]);
+		hist_add(&detach, now_nsec() - t);
+	}
+
+	/* the same, member by member, as far as a condvar takes them */
+	for (i = 0; size <= BOOST_MAX_HELPERS &&
+		    i < global_args.iterations; i++) {
+		t = now_nsec();
+		for (j = 0; j < size; j++)
+			failed += !!sync_cond_helpers_add(&conds[0],
+							  members[j]);
+		hist_add(&add, now_nsec() - t);
+		t = now_nsec();
+		for (j = 0; j < size; j++)
+			sync_cond_helpers_del(&conds[0], members[j]);
+		hist_add(&del, now_nsec() - t);
+	}
+
+	if (gfailed || failed) {
+		printf("group of %d: %d group attaches, %d per-thread"
+		       " registrations failed\n", size, gfailed, failed);
+		exit(EXIT_FAILURE);
+	}
+
+	/* incremental membership changes, attached everywhere */
+	gfailed += group_attach_all(global_args.nconds);
+	for (i = 0; i < global_args.iterations; i++) {
+		t = now_nsec();
+		sync_group_del(&group, members[0]);
+		hist_add(&leave, now_nsec() - t);
+		t = now_nsec();
+		sync_group_add(&group, members[0]);
+		hist_add(&join, now_nsec() - t);
+	}
+
+	/* wake overhead with the group helping on the waiter's condvar */
+	sync_group_del(&group, members[0]);
+	if (sync_group_add(&group, gettid())) {
+		printf("group of %d: signaler cannot join\n", size);
+		exit(EXIT_FAILURE);
+	}
+	if (sync_backend->boost)
+		boost_reset_stats();
+	waiting = ready = 0;
+	pthread_create(&w, NULL, waiter, NULL);
+	signaler();
+	pthread_join(w, NULL);
+	sync_group_del(&group, gettid());
+	sync_group_add(&group, members[0]);
+
+	group_detach_all(global_args.nconds);
+	sync_group_destroy(&group);
+
+	printf("group of %d, %d condvars, %d iterations\n", size,
+	       global_args.nconds, global_args.iterations);
+	hist_print(stdout, "  group attach", &attach);
+	hist_print(stdout, "  group detach", &detach);
+	if (size <= BOOST_MAX_HELPERS) {
+		hist_print(stdout, "  per-thread attach", &add);
+		hist_print(stdout, "  per-thread detach", &del);
+	} else {
+		printf("  per-thread attach/detach skipped, more than %d"
+		       " helpers\n", BOOST_MAX_HELPERS);
+	}
+	hist_print(stdout, "  member join", &join);
+	hist_print(stdout, "  member leave", &leave);
+	hist_print(stdout, "  wait to signaler", &block);
+	hist_print(stdout, "  signal to wake", &wake);
+	if (sync_backend->boost) {
+		boost_get_stats(&bst);
+		boost_stats_print(stdout, &bst);
+	}
+	fflush(stdout);
+
+	pthread_barrier_wait(&release);
+	for (i = 0; i < size; i++)
+		pthread_join(threads[i], NULL);
+	pthread_barrier_destroy(&joined);
+	pthread_barrier_destroy(&release);
+}
+
+static int parse_sizes(const char *arg)
+{
+	const char *p = arg;
+	char *end;
+	long n;
+
+	global_args.nsizes = 0;
+	while (*p) {
+		n = strtol(p, &end, 10);
+		if (end == p || n < 1 || n > SYNC_GROUP_MAX ||
+		    global_args.nsizes == MAX_SIZES)
+			return 1;
+		global_args.sizes[global_args.nsizes++] = n;
+		p = end;
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return 1;
+	}
+
+	return !global_args.nsizes;
+}
+
+int main(int argc, char *argv[])
+{
+	cpu_set_t mask;
+	int i, opt;
+
+	parse_sizes("1,4,16,64,256");
+	global_args.nconds = 16;
+	global_args.iterations = 1000;
+	global_args.cpu = -1;
+
+	while ((opt = getopt(argc, argv, opt_string)) != -1) {
+		switch (opt) {
+		case 'g':
+			if (parse_sizes(optarg)) {
+				printf("invalid group sizes %s (1..%d)\n",
+				       optarg, SYNC_GROUP_MAX);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 'k':
+			global_args.nconds = atoi(optarg);
+			break;
+		case 'i':
+			global_args.iterations = atoi(optarg);
+			break;
+		case 'C':
+			global_args.cpu = atoi(optarg);
+			break;
+		case 'B':
+			global_args.sync = optarg;
+			break;
+		}
+	}
+
+	if (global_args.iterations < 1 || global_args.nconds < 1 ||
+	    global_args.nconds > MAX_CONDS) {
+		printf("invalid iterations or condvars (1..%d)\n", MAX_CONDS);
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (sync_backend_setup(global_args.sync, 1)) {
+		printf("invalid sync backend %s, one of: %s\n",
+		       global_args.sync, sync_backend_names());
+		exit(EXIT_INV_COMMANDLINE);
+	}
+
+	/* first CPU we are allowed on, unless told otherwise */
+	if (global_args.cpu < 0) {
+		sched_getaffinity(0, sizeof(mask), &mask);
+		for (i = 0; i < CPU_SETSIZE && !CPU_ISSET(i, &mask); i++)
+			;
+		global_args.cpu = i;
+	}
+	pin_thread(SIGNAL_PRIO);
+
+	sync_mutex_init(&lock, 0);
+	for (i = 0; i < global_args.nconds; i++)
+		sync_cond_init(&conds[i]);
+
+	printf("Main(): %s sync backend, cpu %d, %s helper groups\n",
+	       sync_backend->name, global_args.cpu,
+	       sync_backend->group_attach ? "native" : "emulated");
+
+	for (i = 0; i < global_args.nsizes; i++)
+		run_size(global_args.sizes[i]);
+
+	for (i = 0; i < global_args.nconds; i++)
+		sync_cond_destroy(&conds[i]);
+	sync_mutex_destroy(&lock);
+
+	return 0;
+}
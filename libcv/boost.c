@@ -0,0 +1,958 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "dl_syscalls.h"
+#include "boost.h"
+
+static boost_thread_t threads[BOOST_MAX_THREADS];
+static __thread boost_thread_t *self;
+static pthread_key_t self_key;		/* gives the slot back at exit */
+static unsigned long releases;		/* slots given back so far */
+static __thread unsigned long self_refused;	/* releases + 1, pool full */
+
+static pthread_mutex_t engine_lock;
+static pthread_once_t engine_once = PTHREAD_ONCE_INIT;
+static int max_depth = BOOST_MAX_DEPTH;
+static unsigned long long learn_window;
+static unsigned long long budget_runtime, budget_period;
+static pthread_t watchdog;
+static int watchdog_started;
+static unsigned int watchdog_kick;	/* futex, bumped to wake it up early */
+static unsigned long long watchdog_next;	/* its next wake up (nsec) */
+static boost_stats_t stats;
+
+#define stat_inc(field)	__atomic_add_fetch(&stats.field, 1, __ATOMIC_RELAXED)
+
+/* Remove p from array v of n elements, unordered; -1 if not there */
+#define array_del(v, n, p) ({					\
+	int __i, __ret = -1;					\
+	for (__i = 0; __i < (n); __i++) {			\
+		if ((v)[__i] == (p)) {				\
+			(v)[__i] = (v)[--(n)];			\
+			__ret = 0;				\
+			break;					\
+		}						\
+	}							\
+	__ret;							\
+})
+
+static void thread_exit(void *arg);
+
+static void engine_init(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&engine_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	pthread_key_create(&self_key, thread_exit);
+}
+
+static void engine_enter(void)
+{
+	pthread_once(&engine_once, engine_init);
+	pthread_mutex_lock(&engine_lock);
+}
+
+static void engine_exit(void)
+{
+	pthread_mutex_unlock(&engine_lock);
+}
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* CPU time consumed by any thread of ours (nsec) */
+static unsigned long long cpu_nsec(pid_t tid)
+{
+	/* MAKE_THREAD_CPUCLOCK(tid, CPUCLOCK_SCHED) */
+	clockid_t clk = ((~(clockid_t)tid) << 3) | 6;
+	struct timespec now;
+
+	if (clock_gettime(clk, &now) != 0)
+		return 0;
+
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void obj_propagate(boost_obj_t *o, int depth);
+
+/*
+ * Called with engine_lock held: t is gone, take it off everything it owns,
+ * helps with, waits on or is a member of, and give its slot back. Nobody
+ * depends on t's own priority, only the object it was blocked on changes.
+ */
+static void thread_release(boost_thread_t *t)
+{
+	boost_thread_t **p;
+	boost_obj_t *o;
+	int i;
+
+	while (t->nr_serves) {
+		o = t->serves[--t->nr_serves];
+		if (o->owner == t)
+			o->owner = NULL;
+		array_del(o->helpers, o->nr_helpers, t);
+		/* learned helpers are served, drop what was learned too */
+		for (i = 0; i < BOOST_MAX_HELPERS; i++) {
+			if (o->signalers[i].t != t)
+				continue;
+			o->signalers[i].helper = 0;
+			__atomic_store_n(&o->signalers[i].t, NULL,
+					 __ATOMIC_RELEASE);
+		}
+	}
+	for (i = 0; i < t->nr_groups; i++)
+		array_del(t->groups[i]->members, t->groups[i]->nr_members, t);
+
+	o = t->blocked_on;
+	if (o) {
+		for (p = &o->waiters; *p; p = &(*p)->next_waiter) {
+			if (*p == t) {
+				*p = t->next_waiter;
+				break;
+			}
+		}
+	}
+	memset(t, 0, sizeof(*t));
+	if (o)
+		obj_propagate(o, 0);
+	__atomic_add_fetch(&releases, 1, __ATOMIC_RELAXED);
+}
+
+/* Key destructor, the calling thread exits */
+static void thread_exit(void *arg)
+{
+	engine_enter();
+	thread_release(arg);
+	engine_exit();
+}
+
+/*
+ * Called with engine_lock held, the pool is full. A thread named as a
+ * helper by somebody else, that never used the engine itself, has no key
+ * to give its slot back: look for the ones that exited.
+ */
+static boost_thread_t *thread_reclaim(void)
+{
+	boost_thread_t *t, *free = NULL;
+	int i;
+
+	for (i = 0; i < BOOST_MAX_THREADS; i++) {
+		t = &threads[i];
+		if (!t->tid ||
+		    syscall(SYS_tgkill, getpid(), t->tid, 0) == 0 ||
+		    errno != ESRCH)
+			continue;
+		thread_release(t);
+		if (!free)
+			free = t;
+	}
+
+	return free;
+}
+
+/* Called with engine_lock held */
+static boost_thread_t *thread_get(pid_t tid)
+{
+	boost_thread_t *t, *free = NULL;
+	struct sched_param param;
+	int i;
+
+	for (i = 0; i < BOOST_MAX_THREADS; i++) {
+		t = &threads[i];
+		if (t->tid == tid)
+			return t;
+		if (!t->tid && !free)
+			free = t;
+	}
+	if (!free)
+		free = thread_reclaim();
+	if (!free) {
+		stats.exhausted++;
+		return NULL;
+	}
+
+	memset(free, 0, sizeof(*free));
+	free->tid = tid;
+	free->policy = sched_getscheduler(tid);
+	if (free->policy < 0 || sched_getparam(tid, &param) != 0) {
+		free->policy = SCHED_OTHER;
+		param.sched_priority = 0;
+	}
+	free->prio = free->eff = param.sched_priority;
+	if (!self && tid == gettid()) {
+		self = free;
+		pthread_setspecific(self_key, self);
+	}
+
+	return free;
+}
+
+static void serves_add(boost_thread_t *t, boost_obj_t *o)
+{
+	if (t->nr_serves < BOOST_MAX_SERVES)
+		t->serves[t->nr_serves++] = o;
+}
+
+static void serves_del(boost_thread_t *t, boost_obj_t *o)
+{
+	int i;
+
+	for (i = 0; i < t->nr_serves; i++) {
+		if (t->serves[i] == o) {
+			t->serves[i] = t->serves[--t->nr_serves];
+			return;
+		}
+	}
+}
+
+/* Highest effective priority among the threads blocked on o */
+static int obj_top(boost_obj_t *o)
+{
+	boost_thread_t *w;
+	int top = 0;
+
+	/* a waiter past its deadline is leaving, it donates nothing */
+	for (w = o->waiters; w; w = w->next_waiter)
+		if (!w->timed_out && w->eff > top)
+			top = w->eff;
+
+	return top;
+}
+
+static void thread_apply(boost_thread_t *t)
+{
+	struct sched_param param;
+	int policy = t->policy;
+
+	param.sched_priority = t->eff;
+	if (t->eff > t->prio && policy != SCHED_FIFO && policy != SCHED_RR)
+		policy = SCHED_FIFO;
+	else if (t->eff == t->prio)
+		param.sched_priority = t->prio;
+
+	if (sched_setscheduler(t->tid, policy, &param) != 0)
+		stats.failures++;
+	t->boosted_at = now_nsec();
+}
+
+static void watchdog_arm(unsigned long long deadline);
+
+/* Highest priority t inherits from the objects it serves */
+static int thread_inherited(boost_thread_t *t)
+{
+	int i, j, top, eff = t->prio;
+	boost_group_t *g;
+
+	for (i = 0; i < t->nr_serves && !t->throttled; i++) {
+		top = obj_top(t->serves[i]);
+		if (top > eff)
+			eff = top;
+	}
+	for (i = 0; i < t->nr_groups && !t->throttled; i++) {
+		g = t->groups[i];
+		for (j = 0; j < g->nr_objs; j++) {
+			top = obj_top(g->objs[j]);
+			if (top > eff)
+				eff = top;
+		}
+	}
+
+	return eff;
+}
+
+/*
+ * Recompute what t inherits, and pass any change on. A thread reached
+ * again by another path (a diamond: two helpers blocked on a mutex whose
+ * owner helps too) is recomputed again, its inputs may have changed; one
+ * reached again while its own change is still being passed on (a cycle)
+ * is only marked, and recomputes once that is done, until nothing changes.
+ */
+static void thread_recompute(boost_thread_t *t, int depth)
+{
+	int eff, rounds = 0;
+
+	if (t->visiting) {
+		stats.revisits++;
+		t->dirty = 1;
+		return;
+	}
+	t->visiting = 1;
+
+	do {
+		t->dirty = 0;
+		eff = thread_inherited(t);
+		if (eff == t->eff)
+			break;
+
+		if (eff > t->eff)
+			stats.boosts++;
+		else
+			stats.deboosts++;
+		/* budget accounting, from unboosted to boosted and back */
+		if (budget_runtime && t->eff == t->prio)
+			t->cpu_at = cpu_nsec(t->tid);
+		else if (budget_runtime && eff == t->prio)
+			t->used += cpu_nsec(t->tid) - t->cpu_at;
+		t->eff = eff;
+		thread_apply(t);
+
+		if (t->blocked_on)
+			obj_propagate(t->blocked_on, depth + 1);
+	} while (t->dirty && ++rounds < max_depth);
+
+	t->visiting = 0;
+}
+
+static int helper_add(boost_obj_t *o, boost_thread_t *t)
+{
+	if (o->nr_helpers == BOOST_MAX_HELPERS)
+		return -1;
+
+	o->helpers[o->nr_helpers++] = t;
+	serves_add(t, o);
+	thread_recompute(t, 0);
+
+	return 0;
+}
+
+static int helper_del(boost_obj_t *o, boost_thread_t *t)
+{
+	int i;
+
+	for (i = 0; i < o->nr_helpers; i++) {
+		if (o->helpers[i] != t)
+			continue;
+		o->helpers[i] = o->helpers[--o->nr_helpers];
+		serves_del(t, o);
+		thread_recompute(t, 0);
+		return 0;
+	}
+
+	return -1;
+}
+
+static int is_helper(boost_obj_t *o, boost_thread_t *t)
+{
+	int i, j;
+
+	for (i = 0; i < o->nr_helpers; i++)
+		if (o->helpers[i] == t)
+			return 1;
+	for (i = 0; i < t->nr_groups; i++)
+		for (j = 0; j < o->nr_groups; j++)
+			if (t->groups[i] == o->groups[j])
+				return 1;
+
+	return 0;
+}
+
+/*
+ * Turn recent signalers into helpers and forget the quiet ones. Their
+ * counters change under us: a torn read only delays learning by a signal.
+ */
+static void obj_learn(boost_obj_t *o, unsigned long long now)
+{
+	boost_signaler_t *sg;
+	unsigned long long last;
+	int i;
+
+	for (i = 0; i < BOOST_MAX_HELPERS; i++) {
+		sg = &o->signalers[i];
+		last = __atomic_load_n(&sg->last, __ATOMIC_RELAXED);
+		/* free, or claimed and no signal through yet */
+		if (!__atomic_load_n(&sg->t, __ATOMIC_RELAXED) || !last)
+			continue;
+		if ((long long)(now - last) >= (long long)learn_window) {
+			if (sg->helper && helper_del(o, sg->t) == 0)
+				stats.forgotten++;
+			sg->helper = 0;
+			/* the owner sees the slot go, see boost_signaled() */
+			__atomic_store_n(&sg->t, NULL, __ATOMIC_RELEASE);
+			continue;
+		}
+		/* a count older than the window says nothing */
+		if (!sg->helper &&
+		    __atomic_load_n(&sg->count, __ATOMIC_RELAXED) >=
+		    BOOST_LEARN_MIN &&
+		    (long long)(now - __atomic_load_n(&sg->since,
+						      __ATOMIC_RELAXED)) <
+		    (long long)learn_window &&
+		    !is_helper(o, sg->t) && helper_add(o, sg->t) == 0) {
+			sg->helper = 1;
+			stats.learned++;
+		}
+	}
+}
+
+static void obj_propagate(boost_obj_t *o, int depth)
+{
+	boost_group_t *g;
+	int i, j;
+
+	if (depth >= max_depth) {
+		stats.truncated++;
+		return;
+	}
+
+	if (o->kind == BOOST_MUTEX) {
+		if (o->owner)
+			thread_recompute(o->owner, depth);
+		return;
+	}
+	for (i = 0; i < o->nr_helpers; i++)
+		thread_recompute(o->helpers[i], depth);
+	for (i = 0; i < o->nr_groups; i++) {
+		g = o->groups[i];
+		for (j = 0; j < g->nr_members; j++)
+			thread_recompute(g->members[j], depth);
+	}
+}
+
+void boost_obj_init(boost_obj_t *o, boost_kind_t kind)
+{
+	memset(o, 0, sizeof(*o));
+	o->kind = kind;
+}
+
+boost_thread_t *boost_self(void)
+{
+	if (self)
+		return self;
+	/* the pool was full, and no slot came back since */
+	if (self_refused &&
+	    self_refused == __atomic_load_n(&releases, __ATOMIC_RELAXED) + 1)
+		return NULL;
+
+	engine_enter();
+	self = thread_get(gettid());
+	/* named as a helper before, its slot is ours now */
+	if (self)
+		pthread_setspecific(self_key, self);
+	else
+		self_refused = releases + 1;
+	engine_exit();
+
+	return self;
+}
+
+int boost_helpers_add(boost_obj_t *o, pid_t tid)
+{
+	boost_thread_t *t;
+	int ret = -1;
+
+	engine_enter();
+	t = thread_get(tid);
+	if (t)
+		ret = helper_add(o, t);
+	engine_exit();
+
+	return ret;
+}
+
+int boost_helpers_del(boost_obj_t *o, pid_t tid)
+{
+	boost_thread_t *t;
+	int ret = -1;
+
+	engine_enter();
+	t = thread_get(tid);
+	if (t)
+		ret = helper_del(o, t);
+	engine_exit();
+
+	return ret;
+}
+
+void boost_group_init(boost_group_t *g)
+{
+	memset(g, 0, sizeof(*g));
+}
+
+int boost_group_add(boost_group_t *g, pid_t tid)
+{
+	boost_thread_t *t;
+	int ret = -1;
+
+	engine_enter();
+	t = thread_get(tid);
+	if (t && g->nr_members < BOOST_GROUP_MAX &&
+	    t->nr_groups < BOOST_MAX_GROUPS) {
+		g->members[g->nr_members++] = t;
+		t->groups[t->nr_groups++] = g;
+		thread_recompute(t, 0);
+		ret = 0;
+	}
+	engine_exit();
+
+	return ret;
+}
+
+int boost_group_del(boost_group_t *g, pid_t tid)
+{
+	boost_thread_t *t;
+	int ret = -1;
+
+	engine_enter();
+	t = thread_get(tid);
+	if (t && array_del(g->members, g->nr_members, t) == 0) {
+		array_del(t->groups, t->nr_groups, g);
+		thread_recompute(t, 0);
+		ret = 0;
+	}
+	engine_exit();
+
+	return ret;
+}
+
+int boost_group_attach(boost_group_t *g, boost_obj_t *o)
+{
+	int i, ret = -1;
+
+	engine_enter();
+	if (g->nr_objs < BOOST_MAX_SERVES && o->nr_groups < BOOST_MAX_GROUPS) {
+		g->objs[g->nr_objs++] = o;
+		o->groups[o->nr_groups++] = g;
+		/* only the members can change, and only if o has waiters */
+		for (i = 0; o->waiters && i < g->nr_members; i++)
+			thread_recompute(g->members[i], 0);
+		ret = 0;
+	}
+	engine_exit();
+
+	return ret;
+}
+
+int boost_group_detach(boost_group_t *g, boost_obj_t *o)
+{
+	int i, ret = -1;
+
+	engine_enter();
+	if (array_del(g->objs, g->nr_objs, o) == 0) {
+		array_del(o->groups, o->nr_groups, g);
+		for (i = 0; o->waiters && i < g->nr_members; i++)
+			thread_recompute(g->members[i], 0);
+		ret = 0;
+	}
+	engine_exit();
+
+	return ret;
+}
+
+/* t's counters on o, in a slot claimed on the first signal; may be NULL */
+static boost_signaler_t *signaler_claim(boost_obj_t *o, boost_thread_t *t)
+{
+	boost_signaler_t *sg, *none;
+	int i;
+
+	/* only t claims slots for t, and the engine only frees them */
+	for (i = 0; i < BOOST_MAX_HELPERS; i++) {
+		sg = &o->signalers[i];
+		if (__atomic_load_n(&sg->t, __ATOMIC_ACQUIRE) == t)
+			return sg;
+	}
+	for (i = 0; i < BOOST_MAX_HELPERS; i++) {
+		sg = &o->signalers[i];
+		none = NULL;
+		if (!__atomic_compare_exchange_n(&sg->t, &none, t, 0,
+						 __ATOMIC_ACQUIRE,
+						 __ATOMIC_RELAXED))
+			continue;
+		__atomic_store_n(&sg->count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&sg->since, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&sg->last, 0, __ATOMIC_RELAXED);
+		return sg;
+	}
+
+	return NULL;
+}
+
+void boost_signaled(boost_obj_t *o)
+{
+	boost_thread_t *t = boost_self();
+	boost_signaler_t *sg = NULL;
+	unsigned long long now;
+	int i;
+
+	if (!t)
+		return;
+
+	/* racy reads, the lists only change under engine_lock */
+	if (__atomic_load_n(&o->waiters, __ATOMIC_RELAXED)) {
+		stat_inc(signals);
+		if (is_helper(o, t))
+			stat_inc(signals_helper);
+	}
+
+	if (!learn_window)
+		return;
+
+	/* no engine_lock, obj_learn() does the rest when a waiter blocks */
+	for (i = 0; i < BOOST_SIG_CACHE; i++) {
+		if (t->sig_obj[i] == o) {
+			sg = t->sig_slot[i];
+			break;
+		}
+	}
+	/* forgotten since, or o is a new condvar at the same address */
+	if (!sg || __atomic_load_n(&sg->t, __ATOMIC_ACQUIRE) != t) {
+		sg = signaler_claim(o, t);
+		if (!sg)
+			return;
+		if (i == BOOST_SIG_CACHE) {
+			i = t->sig_next;
+			t->sig_next = (i + 1) % BOOST_SIG_CACHE;
+		}
+		t->sig_obj[i] = o;
+		t->sig_slot[i] = sg;
+	}
+
+	/*
+	 * A signal racing with the engine freeing the slot may land in it
+	 * after the fact, and count for its next owner: learning is a guess
+	 * anyway.
+	 */
+	now = now_nsec();
+	if (now - sg->since >= learn_window) {
+		__atomic_store_n(&sg->count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&sg->since, now, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&sg->count, sg->count + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&sg->last, now, __ATOMIC_RELAXED);
+}
+
+void boost_block(boost_obj_t *o)
+{
+	boost_block_timed(o, NULL);
+}
+
+void boost_block_timed(boost_obj_t *o, const struct timespec *abstime)
+{
+	boost_thread_t *t = boost_self();
+
+	if (!t)
+		return;
+
+	engine_enter();
+	if (o->kind == BOOST_COND) {
+		if (learn_window)
+			obj_learn(o, now_nsec());
+		stats.waits++;
+		if (o->nr_helpers || o->nr_groups)
+			stats.waits_helped++;
+	}
+	t->deadline = 0;
+	t->timed_out = 0;
+	if (abstime) {
+		stats.timed_waits++;
+		t->deadline = abstime->tv_sec * 1000000000ULL +
+			      abstime->tv_nsec;
+		/* too late for a helper to make a difference */
+		if (t->deadline <= now_nsec()) {
+			t->timed_out = 1;
+			stats.timeouts++;
+		} else {
+			watchdog_arm(t->deadline);
+		}
+	}
+	t->blocked_on = o;
+	t->next_waiter = o->waiters;
+	o->waiters = t;
+	obj_propagate(o, 0);
+	engine_exit();
+}
+
+void boost_unblock(boost_obj_t *o)
+{
+	boost_thread_t *t = boost_self(), **p;
+	unsigned long deboosts;
+	int late;
+
+	if (!t)
+		return;
+
+	engine_enter();
+	for (p = &o->waiters; *p; p = &(*p)->next_waiter) {
+		if (*p == t) {
+			*p = t->next_waiter;
+			break;
+		}
+	}
+	/* the watchdog did not get to it first */
+	late = t->deadline && !t->timed_out && now_nsec() >= t->deadline;
+	t->blocked_on = NULL;
+	t->next_waiter = NULL;
+	t->deadline = 0;
+	t->timed_out = 0;
+	deboosts = stats.deboosts;
+	obj_propagate(o, 0);
+	if (late) {
+		stats.timeouts++;
+		stats.spurious += stats.deboosts - deboosts;
+	}
+	engine_exit();
+}
+
+void boost_own(boost_obj_t *o)
+{
+	boost_thread_t *t = boost_self();
+
+	if (!t)
+		return;
+
+	engine_enter();
+	o->owner = t;
+	serves_add(t, o);
+	thread_recompute(t, 0);
+	engine_exit();
+}
+
+void boost_disown(boost_obj_t *o)
+{
+	boost_thread_t *t = boost_self();
+
+	if (!t)
+		return;
+
+	engine_enter();
+	o->owner = NULL;
+	serves_del(t, o);
+	thread_recompute(t, 0);
+	engine_exit();
+}
+
+void boost_set_max_depth(int depth)
+{
+	max_depth = depth;
+}
+
+void boost_set_learning(unsigned long long window)
+{
+	learn_window = window;
+}
+
+/* Revoke boosts over budget, and re-arm them when a new period starts */
+static void budget_check(int rearm)
+{
+	unsigned long long cpu;
+	boost_thread_t *t;
+	int i;
+
+	for (i = 0; i < BOOST_MAX_THREADS; i++) {
+		t = &threads[i];
+		if (!t->tid)
+			continue;
+		if (rearm) {
+			if (t->eff > t->prio)
+				t->cpu_at = cpu_nsec(t->tid);
+			t->used = 0;
+			if (!t->throttled)
+				continue;
+			t->throttled = 0;
+			stats.rearmed++;
+		} else {
+			if (t->throttled || t->eff == t->prio)
+				continue;
+			cpu = cpu_nsec(t->tid);
+			if (t->used + cpu - t->cpu_at < budget_runtime)
+				continue;
+			t->throttled = 1;
+			stats.expired++;
+		}
+		thread_recompute(t, 0);
+	}
+}
+
+/*
+ * Waiters still blocked past their deadline stop donating, so that their
+ * helpers do not keep the boost until the waiter gets the CPU back: a
+ * helper boosted to the waiter's priority keeps it off the CPU until the
+ * helper blocks. Returns the next deadline to wake up for, 0 if none.
+ */
+static unsigned long long deadline_check(unsigned long long now)
+{
+	unsigned long long next = 0;
+	unsigned long deboosts;
+	boost_thread_t *t;
+	int i;
+
+	for (i = 0; i < BOOST_MAX_THREADS; i++) {
+		t = &threads[i];
+		if (!t->tid || !t->deadline || t->timed_out || !t->blocked_on)
+			continue;
+		if (t->deadline > now) {
+			if (!next || t->deadline < next)
+				next = t->deadline;
+			continue;
+		}
+		t->timed_out = 1;
+		stats.timeouts++;
+		deboosts = stats.deboosts;
+		obj_propagate(t->blocked_on, 0);
+		stats.spurious += stats.deboosts - deboosts;
+	}
+
+	return next;
+}
+
+/*
+ * Budget ticks (a quarter of runtime) and waiter deadlines, whichever
+ * comes first; a new deadline earlier than the one the watchdog sleeps
+ * for kicks it awake.
+ */
+static void *watchdog_fn(void *arg)
+{
+	unsigned long long tick, now, next_tick = 0, period_end = 0, next;
+	struct sched_param param;
+	struct timespec ts;
+	unsigned int kick;
+
+	param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+	pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+	for (;;) {
+		engine_enter();
+		now = now_nsec();
+		tick = budget_runtime / 4;
+		if (tick > budget_period / 4)
+			tick = budget_period / 4;
+		if (tick < 10000)
+			tick = 10000;
+		if (budget_runtime && !next_tick) {
+			period_end = now + budget_period;
+			next_tick = now + tick;
+		} else if (budget_runtime && now >= next_tick) {
+			budget_check(now >= period_end);
+			if (now >= period_end)
+				period_end = now + budget_period;
+			next_tick += tick;
+		}
+
+		next = deadline_check(now);
+		if (budget_runtime && (!next || next_tick < next))
+			next = next_tick;
+		watchdog_next = next;
+		kick = watchdog_kick;
+		engine_exit();
+
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		syscall(__NR_futex, &watchdog_kick,
+			FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, kick,
+			next ? &ts : NULL, NULL, FUTEX_BITSET_MATCH_ANY);
+	}
+
+	return arg;
+}
+
+/* Called with engine_lock held */
+static int watchdog_start(void)
+{
+	int ret;
+
+	if (watchdog_started)
+		return 0;
+
+	ret = pthread_create(&watchdog, NULL, watchdog_fn, NULL);
+	if (ret)
+		return -1;
+	pthread_detach(watchdog);
+	watchdog_started = 1;
+
+	return 0;
+}
+
+static void watchdog_wake(void)
+{
+	__atomic_add_fetch(&watchdog_kick, 1, __ATOMIC_SEQ_CST);
+	syscall(__NR_futex, &watchdog_kick, FUTEX_WAKE | FUTEX_PRIVATE_FLAG,
+		1, NULL, NULL, 0);
+}
+
+/*
+ * Called with engine_lock held. Without a watchdog the waiter withdraws
+ * its boost itself, once it runs again.
+ */
+static void watchdog_arm(unsigned long long deadline)
+{
+	if (watchdog_start())
+		return;
+	if (watchdog_next && watchdog_next <= deadline)
+		return;
+
+	watchdog_next = deadline;
+	watchdog_wake();
+}
+
+int boost_set_budget(unsigned long long runtime, unsigned long long period)
+{
+	int ret = 0;
+
+	engine_enter();
+	budget_runtime = runtime;
+	budget_period = period;
+	if (runtime)
+		ret = watchdog_start();
+	/* it may be asleep with no deadline to wake up for */
+	if (ret == 0 && watchdog_started)
+		watchdog_wake();
+	engine_exit();
+
+	return ret;
+}
+
+void boost_get_stats(boost_stats_t *st)
+{
+	engine_enter();
+	*st = stats;
+	engine_exit();
+}
+
+void boost_reset_stats(void)
+{
+	engine_enter();
+	memset(&stats, 0, sizeof(stats));
+	engine_exit();
+}
+
+void boost_stats_print(FILE *out, const boost_stats_t *st)
+{
+	fprintf(out, "uboost: %lu boosts, %lu deboosts, %lu truncated,"
+		" %lu revisits, %lu failed\n", st->boosts, st->deboosts,
+		st->truncated, st->revisits, st->failures);
+	fprintf(out, "  %.1f%% of %lu waits had helpers, %.1f%% of %lu"
+		" signals came from helpers\n",
+		st->waits ? 100.0 * st->waits_helped / st->waits : 0.0,
+		st->waits,
+		st->signals ? 100.0 * st->signals_helper / st->signals : 0.0,
+		st->signals);
+	if (st->exhausted)
+		fprintf(out, "  %lu threads not registered, all %d slots in"
+			" use\n", st->exhausted, BOOST_MAX_THREADS);
+	if (learn_window)
+		fprintf(out, "  learning over %llu usec: %lu helpers learned,"
+			" %lu forgotten\n", learn_window / 1000,
+			st->learned, st->forgotten);
+	if (budget_runtime)
+		fprintf(out, "  budget %llu usec every %llu usec: %lu boosts"
+			" expired, %lu re-armed\n", budget_runtime / 1000,
+			budget_period / 1000, st->expired, st->rearmed);
+	if (st->timed_waits)
+		fprintf(out, "  %lu timed waits, %lu reached the deadline,"
+			" %lu helper deboosts at a deadline\n",
+			st->timed_waits, st->timeouts, st->spurious);
+}
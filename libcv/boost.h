@@ -0,0 +1,214 @@
+/*
+ * Userspace helper boosting
+ *
+ * A userspace stand-in for the FUTEX_COND_HELPER_MAN kernel support, so that
+ * helper semantics can be experimented with on any kernel. Threads blocked
+ * on an object donate their (effective) priority to the threads the object
+ * depends on: the owner of a mutex, the registered helpers of a condvar.
+ * A boosted thread that is blocked itself passes the boost on, so the
+ * priority travels transitively along chains of condvar and mutex edges,
+ * like rt_mutex PI chains do in the kernel.
+ *
+ * Propagation is bounded (at most boost_max_depth edges from the object
+ * that changed) and cycle-safe (a thread reached again while its change
+ * is being passed on is recomputed once that is done, not re-entered); a
+ * thread reached by two paths is recomputed on both, so that it ends up
+ * with what its inputs give at the end. Boosts are applied with
+ * sched_setscheduler() on the target tid, which needs CAP_SYS_NICE, and
+ * all the bookkeeping runs under one engine lock: this is meant for
+ * measurements, not for production use.
+ *
+ * A thread is registered the first time it uses the engine, or is named as
+ * a helper, with the scheduling parameters it has at that point: set the
+ * priority before touching any boosted object. A thread gives its slot
+ * back, and drops every edge it has, when it exits; one that was only ever
+ * named by others is noticed to be gone when the pool fills up.
+ *
+ * In learning mode (boost_set_learning()) helpers need not be registered
+ * by hand: every signal bumps the signalling thread's own counter on the
+ * condvar, restarting it when it gets older than the window, with relaxed
+ * atomics and no lock (a thread finds its counters through a small cache
+ * of the condvars it signalled last). When a waiter blocks, already under
+ * the engine lock, the threads that signalled at least BOOST_LEARN_MIN
+ * times within the window become helpers, while those that went quiet for
+ * a whole window are dropped again.
+ *
+ * A boost can be given a budget (boost_set_budget()), in the spirit of the
+ * SCHED_DEADLINE runtime/period pair: a helper that burns more than runtime
+ * of CPU while boosted within a period is throttled back to its own
+ * priority, and the boost is re-armed when the next period starts. Budgets
+ * are enforced by a watchdog thread at the highest SCHED_FIFO priority, so
+ * the overrun is bounded by its tick (a quarter of runtime).
+ *
+ * A timed wait (boost_block_timed()) donates only until its deadline: the
+ * same watchdog wakes up at the earliest one and withdraws what the
+ * waiters still blocked there gave, so that a helper boosted for a waiter
+ * that gave up does not keep the boost until the waiter runs again.
+ *
+ * Helper groups (boost_group_t) are sets of threads that help on any
+ * number of condvars at once: attaching a group to a condvar is one edge,
+ * not one per member, and a member joining or leaving only recomputes
+ * that member.
+ */
+
+#ifndef __BOOST__
+#define __BOOST__
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define BOOST_MAX_THREADS	1024
+#define BOOST_MAX_HELPERS	64	/* per condvar */
+#define BOOST_MAX_SERVES	64	/* objects a thread owns or helps */
+#define BOOST_MAX_DEPTH		64	/* default propagation bound */
+#define BOOST_LEARN_MIN		2	/* signals before a learned helper */
+#define BOOST_MAX_GROUPS	8	/* groups per condvar, or per thread */
+#define BOOST_GROUP_MAX		256	/* threads in a group */
+#define BOOST_SIG_CACHE		4	/* condvars a thread signals cheaply */
+
+typedef enum boost_kind_t
+{
+	BOOST_MUTEX = 0,
+	BOOST_COND
+} boost_kind_t;
+
+struct boost_thread;
+struct boost_group;
+
+/*
+ * A thread seen signalling a condvar, learning mode. The thread claims the
+ * slot and alone writes count, since and last, without the engine lock;
+ * the engine reads them, and frees the slot, under it.
+ */
+typedef struct boost_signaler {
+	struct boost_thread *t;
+	unsigned long count;		/* signals since ... */
+	unsigned long long since;	/* ... this, within a window (nsec) */
+	unsigned long long last;	/* last signal (nsec) */
+	int helper;			/* registered by the engine */
+} boost_signaler_t;
+
+typedef struct boost_obj {
+	boost_kind_t kind;
+	struct boost_thread *owner;		/* mutex */
+	struct boost_thread *helpers[BOOST_MAX_HELPERS];	/* condvar */
+	int nr_helpers;
+	struct boost_thread *waiters;		/* blocked on the object */
+	boost_signaler_t signalers[BOOST_MAX_HELPERS];
+	struct boost_group *groups[BOOST_MAX_GROUPS];	/* condvar */
+	int nr_groups;
+} boost_obj_t;
+
+typedef struct boost_group {
+	struct boost_thread *members[BOOST_GROUP_MAX];
+	int nr_members;
+	boost_obj_t *objs[BOOST_MAX_SERVES];	/* condvars attached to */
+	int nr_objs;
+} boost_group_t;
+
+typedef struct boost_thread {
+	pid_t tid;
+	int policy;			/* base scheduling parameters */
+	int prio;
+	int eff;			/* effective priority */
+	boost_obj_t *blocked_on;
+	struct boost_thread *next_waiter;
+	boost_obj_t *serves[BOOST_MAX_SERVES];
+	int nr_serves;
+	boost_group_t *groups[BOOST_MAX_GROUPS];	/* member of */
+	int nr_groups;
+	int visiting;			/* being recomputed, cycles stop here */
+	int dirty;			/* ... and reached again meanwhile */
+	unsigned long long boosted_at;	/* last priority change (nsec) */
+	unsigned long long cpu_at;	/* CPU clock when boosted (nsec) */
+	unsigned long long used;	/* boosted CPU time this period */
+	int throttled;			/* budget exhausted, boost revoked */
+	unsigned long long deadline;	/* timed wait gives up (nsec), or 0 */
+	int timed_out;			/* ... and did, donates no more */
+	boost_obj_t *sig_obj[BOOST_SIG_CACHE];	/* signalled lately, */
+	boost_signaler_t *sig_slot[BOOST_SIG_CACHE];	/* its slot there */
+	int sig_next;			/* cache entry to replace next */
+} boost_thread_t;
+
+typedef struct boost_stats {
+	unsigned long boosts;		/* priority raised */
+	unsigned long deboosts;		/* priority lowered */
+	unsigned long truncated;	/* propagation stopped by the bound */
+	unsigned long revisits;		/* thread reached again, cycles */
+	unsigned long failures;		/* sched_setscheduler() failed */
+	unsigned long waits;		/* condvar waits */
+	unsigned long waits_helped;	/* ... with some helper to boost */
+	unsigned long signals;		/* signals with somebody waiting */
+	unsigned long signals_helper;	/* ... sent by a helper */
+	unsigned long learned;		/* helpers added by learning */
+	unsigned long forgotten;	/* helpers dropped by aging */
+	unsigned long expired;		/* boosts revoked by the budget */
+	unsigned long rearmed;		/* ... and given back later */
+	unsigned long timed_waits;	/* blocked with a deadline */
+	unsigned long timeouts;		/* ... still blocked when it came */
+	unsigned long spurious;		/* deboosts it caused, helpers that
+					   were boosted for nothing */
+	unsigned long exhausted;	/* threads not registered, pool full */
+} boost_stats_t;
+
+void boost_obj_init(boost_obj_t *o, boost_kind_t kind);
+
+/* The calling thread, registered on first use; NULL if the pool is full */
+boost_thread_t *boost_self(void);
+
+/* Edges from objects to the threads they depend on */
+int boost_helpers_add(boost_obj_t *o, pid_t tid);
+
+int boost_helpers_del(boost_obj_t *o, pid_t tid);
+
+void boost_group_init(boost_group_t *g);
+
+/* Membership, effective on every condvar the group is attached to */
+int boost_group_add(boost_group_t *g, pid_t tid);
+
+int boost_group_del(boost_group_t *g, pid_t tid);
+
+/* Make (stop making) every member of g a helper of condvar o */
+int boost_group_attach(boost_group_t *g, boost_obj_t *o);
+
+int boost_group_detach(boost_group_t *g, boost_obj_t *o);
+
+/* The calling thread signals condvar o (or broadcasts) */
+void boost_signaled(boost_obj_t *o);
+
+/* The calling thread is about to block on o / stopped waiting on o */
+void boost_block(boost_obj_t *o);
+
+void boost_unblock(boost_obj_t *o);
+
+/*
+ * boost_block() for a wait that gives up at abstime (CLOCK_MONOTONIC, may
+ * be NULL). Starts the watchdog thread on first use.
+ */
+void boost_block_timed(boost_obj_t *o, const struct timespec *abstime);
+
+/* The calling thread acquired / is about to release mutex o */
+void boost_own(boost_obj_t *o);
+
+void boost_disown(boost_obj_t *o);
+
+/* Bound on the edges a boost travels, BOOST_MAX_DEPTH by default */
+void boost_set_max_depth(int depth);
+
+/* Learn helpers from signals over window nsec, 0 turns learning off */
+void boost_set_learning(unsigned long long window);
+
+/*
+ * Boosted CPU time a helper may use per period (nsec), 0 for no limit.
+ * Starts the watchdog thread on first use; -1 if it cannot be created.
+ */
+int boost_set_budget(unsigned long long runtime, unsigned long long period);
+
+void boost_get_stats(boost_stats_t *st);
+
+void boost_stats_print(FILE *out, const boost_stats_t *st);
+
+void boost_reset_stats(void);
+
+#endif /* __BOOST__ */
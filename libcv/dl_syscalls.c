@@ -1,4 +1,5 @@
 #include "dl_syscalls.h"
+#include <unistd.h>
 
 int sched_setscheduler2(pid_t pid, int policy,
 			  const struct sched_param2 *param)
@@ -17,22 +18,46 @@ int sched_getparam2(pid_t pid, struct sched_param2 *param)
 	return syscall(__NR_sched_getparam2, pid, param);
 }
 
-int pthread_cond_helpers_add(pthread_cond_t *cond, pid_t pid)
+int futex_helpers_add(unsigned int *uaddr, pid_t pid)
 {
-	unsigned int *pcond;
+	return syscall(__NR_futex, uaddr, FUTEX_COND_HELPER_MAN_PRIVATE,
+		       pid, NULL, NULL, 1);
+}
 
-	pcond = &cond->__data.__futex;
+int futex_helpers_del(unsigned int *uaddr, pid_t pid)
+{
+	return syscall(__NR_futex, uaddr, FUTEX_COND_HELPER_MAN_PRIVATE,
+		       pid, NULL, NULL, 0);
+}
 
-	return syscall(__NR_futex, pcond, FUTEX_COND_HELPER_MAN_PRIVATE,
-		       pid, NULL, NULL, 1);
+int pthread_cond_helpers_add(pthread_cond_t *cond, pid_t pid)
+{
+	return futex_helpers_add(&cond->__data.__futex, pid);
 }
 
 int pthread_cond_helpers_del(pthread_cond_t *cond, pid_t pid)
 {
-	unsigned int *pcond;
+	return futex_helpers_del(&cond->__data.__futex, pid);
+}
 
-	pcond = &cond->__data.__futex;
+int futex_helpers_add_shared(unsigned int *uaddr, pid_t pid)
+{
+	return syscall(__NR_futex, uaddr, FUTEX_COND_HELPER_MAN,
+		       pid, NULL, NULL, 1);
+}
 
-	return syscall(__NR_futex, pcond, FUTEX_COND_HELPER_MAN_PRIVATE,
+int futex_helpers_del_shared(unsigned int *uaddr, pid_t pid)
+{
+	return syscall(__NR_futex, uaddr, FUTEX_COND_HELPER_MAN,
 		       pid, NULL, NULL, 0);
 }
+
+int pthread_cond_helpers_add_shared(pthread_cond_t *cond, pid_t pid)
+{
+	return futex_helpers_add_shared(&cond->__data.__futex, pid);
+}
+
+int pthread_cond_helpers_del_shared(pthread_cond_t *cond, pid_t pid)
+{
+	return futex_helpers_del_shared(&cond->__data.__futex, pid);
+}
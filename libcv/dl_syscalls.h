@@ -78,9 +78,27 @@ int sched_setparam2(pid_t pid,
 
 int sched_getparam2(pid_t pid, struct sched_param2 *param);
 
+/* Helpers of a bare futex word, for waits not built on pthread_cond_t */
+int futex_helpers_add(unsigned int *uaddr, pid_t pid);
+
+int futex_helpers_del(unsigned int *uaddr, pid_t pid);
+
 int pthread_cond_helpers_add(pthread_cond_t *cond, pid_t pid);
 
 int pthread_cond_helpers_del(pthread_cond_t *cond, pid_t pid);
 
+/*
+ * Same, for futexes shared between processes (PTHREAD_PROCESS_SHARED
+ * condvars, words in shared memory): the kernel keys those by mapping,
+ * not by mm, so they need the non-private operation.
+ */
+int futex_helpers_add_shared(unsigned int *uaddr, pid_t pid);
+
+int futex_helpers_del_shared(unsigned int *uaddr, pid_t pid);
+
+int pthread_cond_helpers_add_shared(pthread_cond_t *cond, pid_t pid);
+
+int pthread_cond_helpers_del_shared(pthread_cond_t *cond, pid_t pid);
+
 #endif /* __DL_SYSCALLS__ */
 
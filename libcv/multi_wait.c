@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include "dl_syscalls.h"
+#include "multi_wait.h"
+
+#ifndef __NR_futex_waitv
+#define __NR_futex_waitv		449
+#endif
+
+#ifndef FUTEX_WAITV_MAX
+#define FUTEX_32			2
+#define FUTEX_WAITV_MAX			128
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+#endif
+
+static int futex_wait(unsigned int *uaddr, unsigned int val,
+		      const struct timespec *timeout)
+{
+	return syscall(__NR_futex, uaddr,
+		       FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, val, timeout,
+		       NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+static int futex_wake(unsigned int *uaddr, int nr)
+{
+	return syscall(__NR_futex, uaddr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, nr,
+		       NULL, NULL, 0);
+}
+
+void mq_event_init(mq_event_t *e)
+{
+	memset(e, 0, sizeof(*e));
+}
+
+void mq_event_signal(mq_event_t *e)
+{
+	/*
+	 * Pairs with the waiters increment in mq_wait(): either we see the
+	 * sleeper, or its futex call sees the new sequence and returns.
+	 */
+	__atomic_add_fetch(&e->seq, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&e->waiters, __ATOMIC_SEQ_CST))
+		futex_wake(&e->seq, 1);
+	if (e->group)
+		mq_event_signal(e->group);
+}
+
+int mq_event_helpers_add(mq_event_t *e, pid_t pid)
+{
+	if (e->group)
+		futex_helpers_add(&e->group->seq, pid);
+
+	return futex_helpers_add(&e->seq, pid);
+}
+
+int mq_event_helpers_del(mq_event_t *e, pid_t pid)
+{
+	if (e->group)
+		futex_helpers_del(&e->group->seq, pid);
+
+	return futex_helpers_del(&e->seq, pid);
+}
+
+/* Is futex_waitv() there? A zero sized vector is rejected with EINVAL. */
+static int have_waitv(void)
+{
+	static int have = -1;
+
+	if (have < 0)
+		have = !(syscall(__NR_futex_waitv, NULL, 0, 0, NULL, 0) < 0 &&
+			 errno == ENOSYS);
+
+	return have;
+}
+
+int mq_wait_init(mq_wait_t *w, mq_event_t **events, int nr, int flags)
+{
+	struct futex_waitv *v;
+	int i;
+
+	memset(w, 0, sizeof(*w));
+	if (nr <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	w->nr = nr;
+	w->events = events;
+	w->use_waitv = !(flags & MQ_WAIT_NO_WAITV) &&
+		       nr <= FUTEX_WAITV_MAX && have_waitv();
+
+	if (!w->use_waitv) {
+		mq_event_init(&w->group);
+		for (i = 0; i < nr; i++)
+			events[i]->group = &w->group;
+		return 0;
+	}
+
+	v = calloc(nr, sizeof(*v));
+	if (!v)
+		return -1;
+	for (i = 0; i < nr; i++) {
+		v[i].uaddr = (unsigned long)&events[i]->seq;
+		v[i].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+	}
+	w->waitv = v;
+
+	return 0;
+}
+
+void mq_wait_destroy(mq_wait_t *w)
+{
+	int i;
+
+	for (i = 0; i < w->nr; i++)
+		w->events[i]->group = NULL;
+	free(w->waitv);
+	w->waitv = NULL;
+}
+
+void mq_wait_prepare(mq_wait_t *w)
+{
+	struct futex_waitv *v = w->waitv;
+	int i;
+
+	if (!w->use_waitv) {
+		w->group_val = __atomic_load_n(&w->group.seq,
+					       __ATOMIC_ACQUIRE);
+		return;
+	}
+
+	for (i = 0; i < w->nr; i++)
+		v[i].val = __atomic_load_n(&w->events[i]->seq,
+					   __ATOMIC_ACQUIRE);
+}
+
+int mq_wait(mq_wait_t *w, const struct timespec *timeout)
+{
+	int i, ret;
+
+	if (!w->use_waitv) {
+		__atomic_add_fetch(&w->group.waiters, 1, __ATOMIC_SEQ_CST);
+		ret = futex_wait(&w->group.seq, w->group_val, timeout);
+		__atomic_sub_fetch(&w->group.waiters, 1, __ATOMIC_SEQ_CST);
+	} else {
+		for (i = 0; i < w->nr; i++)
+			__atomic_add_fetch(&w->events[i]->waiters, 1,
+					   __ATOMIC_SEQ_CST);
+		ret = syscall(__NR_futex_waitv, w->waitv, w->nr, 0, timeout,
+			      CLOCK_MONOTONIC);
+		for (i = 0; i < w->nr; i++)
+			__atomic_sub_fetch(&w->events[i]->waiters, 1,
+					   __ATOMIC_SEQ_CST);
+	}
+
+	/* a value changed before we could sleep: that is a wakeup too */
+	if (ret < 0 && errno == EAGAIN)
+		return 0;
+
+	return ret < 0 ? -1 : 0;
+}
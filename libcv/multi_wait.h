@@ -0,0 +1,73 @@
+/*
+ * Multi-queue wait: block until any of a set of events fires
+ *
+ * Every queue owns an mq_event_t, a futex word bumped on each notification.
+ * A consumer serving several queues samples all its events, looks at the
+ * queues and, if they are all empty, sleeps on the sampled values with a
+ * single futex_waitv() (Linux 5.16+). Since the kernel compares the values
+ * before sleeping, a notification racing with the scan is never lost.
+ *
+ * Without futex_waitv(), or with more than FUTEX_WAITV_MAX events, the
+ * events of a set also bump a common group word and the consumer sleeps
+ * on that one instead: correct, but every notification then goes through
+ * the group cacheline.
+ *
+ * Helpers (threads expected to notify an event) are registered on the
+ * event word, and on the group word as well when the fallback is in use,
+ * with the same FUTEX_COND_HELPER_MAN operation used for condvars. The
+ * events have to be in their wait set by then, and these are kernel
+ * registrations whatever the sync backend: the uboost engine never sees
+ * an event.
+ */
+
+#ifndef __MULTI_WAIT__
+#define __MULTI_WAIT__
+
+#include <sys/types.h>
+#include <time.h>
+
+typedef struct mq_event {
+	unsigned int seq;		/* futex word */
+	unsigned int waiters;		/* sleepers, skip the wake if none */
+	struct mq_event *group;		/* fallback group event, or NULL */
+} mq_event_t;
+
+typedef struct mq_wait {
+	int nr;
+	mq_event_t **events;
+	int use_waitv;
+	mq_event_t group;		/* fallback, bumped by every event */
+	unsigned int group_val;
+	void *waitv;			/* struct futex_waitv[nr] */
+} mq_wait_t;
+
+#define MQ_WAIT_NO_WAITV	1	/* force the group fallback */
+
+void mq_event_init(mq_event_t *e);
+
+/* Notify whoever waits on e; cheap (no syscall) if nobody sleeps */
+void mq_event_signal(mq_event_t *e);
+
+int mq_event_helpers_add(mq_event_t *e, pid_t pid);
+
+int mq_event_helpers_del(mq_event_t *e, pid_t pid);
+
+/*
+ * Build a wait set over events[0..nr), before anyone registers helpers on
+ * them. Returns 0 on success; an event can belong to one wait set only.
+ */
+int mq_wait_init(mq_wait_t *w, mq_event_t **events, int nr, int flags);
+
+void mq_wait_destroy(mq_wait_t *w);
+
+/* Sample the events, before checking the queues */
+void mq_wait_prepare(mq_wait_t *w);
+
+/*
+ * Sleep until some event changed since mq_wait_prepare(), or until the
+ * absolute CLOCK_MONOTONIC timeout (if not NULL) expires. Returns 0, or -1
+ * with errno set (ETIMEDOUT, EINTR); spurious returns are possible.
+ */
+int mq_wait(mq_wait_t *w, const struct timespec *timeout);
+
+#endif /* __MULTI_WAIT__ */
@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include "dl_syscalls.h"
+#include "boost.h"
+#include "pi_rwlock.h"
+
+static int futex_wait(unsigned int *uaddr, unsigned int val,
+		      const struct timespec *abstime)
+{
+	return syscall(__NR_futex, uaddr,
+		       FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, val, abstime,
+		       NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+static int futex_wake(unsigned int *uaddr, int nr)
+{
+	return syscall(__NR_futex, uaddr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, nr,
+		       NULL, NULL, 0);
+}
+
+int pi_rwlock_init(pi_rwlock_t *rw)
+{
+	/* private futexes, like pi_sem_t */
+	assert(!sync_backend_is_shared());
+
+	memset(rw, 0, sizeof(*rw));
+	if (!sync_backend->boost) {
+		rw->helpers = sync_helpers_enabled();
+		return 0;
+	}
+
+	/* the holders are known exactly, no need to learn them */
+	rw->helpers = 1;
+	rw->boost = malloc(sizeof(*rw->boost));
+	if (!rw->boost)
+		return ENOMEM;
+	boost_obj_init(rw->boost, BOOST_COND);
+
+	return 0;
+}
+
+void pi_rwlock_destroy(pi_rwlock_t *rw)
+{
+	free(rw->boost);
+	rw->boost = NULL;
+}
+
+/*
+ * The calling thread is about to try for the lock, or gave up on it, or
+ * released it. Registration brackets every acquiring compare-and-swap:
+ * taking the lock word first would leave a window where a thread
+ * preempted right after it holds the lock unboosted. A failed attempt
+ * drops the registration before the thread sleeps, so only the holders,
+ * and threads running an attempt, are ever helpers; sleepers are not.
+ */
+static void holder_add(pi_rwlock_t *rw)
+{
+	if (rw->boost)
+		boost_helpers_add(rw->boost, gettid());
+	else if (rw->helpers)
+		futex_helpers_add(&rw->state, gettid());
+}
+
+static void holder_del(pi_rwlock_t *rw)
+{
+	if (rw->boost)
+		boost_helpers_del(rw->boost, gettid());
+	else if (rw->helpers)
+		futex_helpers_del(&rw->state, gettid());
+}
+
+/* Sleep while the lock word is still val */
+static int rw_sleep(pi_rwlock_t *rw, unsigned int val,
+		    const struct timespec *abstime)
+{
+	int ret = 0;
+
+	/* pairs with rw_wake(), like pi_sem_timedwait() */
+	__atomic_add_fetch(&rw->waiters, 1, __ATOMIC_SEQ_CST);
+	if (futex_wait(&rw->state, val, abstime) < 0 && errno == ETIMEDOUT)
+		ret = ETIMEDOUT;
+	__atomic_sub_fetch(&rw->waiters, 1, __ATOMIC_SEQ_CST);
+
+	return ret;
+}
+
+/*
+ * Everybody races for the lock again; readers that find a writer waiting
+ * go back to sleep. Cheap enough for the handful of threads the stress
+ * programs run.
+ */
+static void rw_wake(pi_rwlock_t *rw)
+{
+	if (__atomic_load_n(&rw->waiters, __ATOMIC_SEQ_CST))
+		futex_wake(&rw->state, INT_MAX);
+}
+
+/* On failure *sp is the lock word that made it fail */
+static int rd_trylock(pi_rwlock_t *rw, unsigned int *sp)
+{
+	unsigned int s = __atomic_load_n(&rw->state, __ATOMIC_RELAXED);
+
+	while (!(s & (PI_RWLOCK_WRITER | PI_RWLOCK_WAITING))) {
+		if (__atomic_compare_exchange_n(&rw->state, &s, s + 1, 0,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			return 0;
+	}
+	*sp = s;
+
+	return EBUSY;
+}
+
+/* One registered attempt, see holder_add() */
+static int rd_attempt(pi_rwlock_t *rw, unsigned int *sp)
+{
+	holder_add(rw);
+	if (rd_trylock(rw, sp) == 0)
+		return 0;
+	holder_del(rw);
+
+	return EBUSY;
+}
+
+/* Writer from s, which has no holder, on behalf of a waiting writer */
+static int wr_attempt(pi_rwlock_t *rw, unsigned int *sp, unsigned int want)
+{
+	holder_add(rw);
+	if (__atomic_compare_exchange_n(&rw->state, sp, want, 0,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return 0;
+	holder_del(rw);
+
+	return EBUSY;
+}
+
+int pi_rwlock_tryrdlock(pi_rwlock_t *rw)
+{
+	unsigned int s;
+
+	return rd_attempt(rw, &s);
+}
+
+int pi_rwlock_trywrlock(pi_rwlock_t *rw)
+{
+	unsigned int s = 0;
+
+	return wr_attempt(rw, &s, PI_RWLOCK_WRITER);
+}
+
+int pi_rwlock_timedrdlock(pi_rwlock_t *rw, const struct timespec *abstime)
+{
+	unsigned int s;
+	int ret = 0;
+
+	if (rd_attempt(rw, &s) == 0)
+		return 0;
+
+	if (rw->boost)
+		boost_block_timed(rw->boost, abstime);
+	while (rd_attempt(rw, &s) != 0) {
+		ret = rw_sleep(rw, s, abstime);
+		if (ret)
+			break;
+	}
+	if (rw->boost)
+		boost_unblock(rw->boost);
+
+	return ret;
+}
+
+int pi_rwlock_timedwrlock(pi_rwlock_t *rw, const struct timespec *abstime)
+{
+	unsigned int s = 0;
+	int ret = 0;
+
+	if (wr_attempt(rw, &s, PI_RWLOCK_WRITER) == 0)
+		return 0;
+
+	if (rw->boost)
+		boost_block_timed(rw->boost, abstime);
+	/* from here on readers keep out */
+	s = __atomic_add_fetch(&rw->state, PI_RWLOCK_WAITER, __ATOMIC_SEQ_CST);
+	for (;;) {
+		if (!(s & (PI_RWLOCK_WRITER | PI_RWLOCK_READERS))) {
+			if (wr_attempt(rw, &s, (s - PI_RWLOCK_WAITER) |
+					       PI_RWLOCK_WRITER) == 0)
+				break;
+			continue;
+		}
+		ret = rw_sleep(rw, s, abstime);
+		if (ret) {
+			/* the readers we kept out may go */
+			__atomic_sub_fetch(&rw->state, PI_RWLOCK_WAITER,
+					   __ATOMIC_SEQ_CST);
+			rw_wake(rw);
+			break;
+		}
+		s = __atomic_load_n(&rw->state, __ATOMIC_RELAXED);
+	}
+	if (rw->boost)
+		boost_unblock(rw->boost);
+
+	return ret;
+}
+
+int pi_rwlock_rdlock(pi_rwlock_t *rw)
+{
+	return pi_rwlock_timedrdlock(rw, NULL);
+}
+
+int pi_rwlock_wrlock(pi_rwlock_t *rw)
+{
+	return pi_rwlock_timedwrlock(rw, NULL);
+}
+
+void pi_rwlock_unlock(pi_rwlock_t *rw)
+{
+	unsigned int s;
+
+	if (__atomic_load_n(&rw->state, __ATOMIC_RELAXED) & PI_RWLOCK_WRITER)
+		s = __atomic_sub_fetch(&rw->state, PI_RWLOCK_WRITER,
+				       __ATOMIC_SEQ_CST);
+	else
+		s = __atomic_sub_fetch(&rw->state, 1, __ATOMIC_SEQ_CST);
+	/* the last reader, or the writer, is gone */
+	if (!(s & PI_RWLOCK_READERS))
+		rw_wake(rw);
+	/*
+	 * Deboost last: dropping the boost while still holding the lock lets
+	 * whatever we were boosted over preempt us right before the release.
+	 */
+	holder_del(rw);
+}
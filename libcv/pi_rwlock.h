@@ -0,0 +1,67 @@
+/*
+ * PI-aware reader-writer lock
+ *
+ * pthread_rwlock_t has no priority inheritance: a high priority writer
+ * waits for every reader to leave, and nothing stops a medium priority
+ * thread from preempting a low priority reader in the meantime, the same
+ * inversion PI condvars deal with. In pi_rwlock_t the threads holding the
+ * lock, the readers or the writer, are its helpers for as long as they
+ * hold it, so whoever blocks on the lock (a writer, or a reader behind a
+ * writer) boosts all of them: in userspace with the uboost sync backends
+ * (libcv/boost.h), through FUTEX_COND_HELPER_MAN on the lock word when the
+ * sync backend registers helpers, not at all otherwise.
+ *
+ * The lock word is the futex: the number of readers, the number of
+ * writers waiting and whether a writer holds the lock, so that every
+ * change a sleeper may be waiting for changes the word. Writers are
+ * preferred, a reader does not get in while a writer waits, so a thread
+ * must not take the read lock twice. A thread registers right before
+ * each attempt at the lock word and drops out again when the attempt
+ * fails, so sleepers are never helpers: that is one or two engine (or
+ * futex) calls per attempt, and the uboost engine takes at most
+ * BOOST_MAX_HELPERS of them: readers past that still get the lock, they
+ * are just not boosted.
+ *
+ * The lock has to be initialized after sync_backend_setup().
+ */
+
+#ifndef __PI_RWLOCK__
+#define __PI_RWLOCK__
+
+#include <time.h>
+#include "sync_backend.h"
+
+#define PI_RWLOCK_READERS	0x0000ffffU	/* readers holding the lock */
+#define PI_RWLOCK_WAITING	0x7fff0000U	/* writers waiting for it */
+#define PI_RWLOCK_WAITER	0x00010000U
+#define PI_RWLOCK_WRITER	0x80000000U	/* a writer holds it */
+
+typedef struct pi_rwlock {
+	unsigned int state;		/* futex word */
+	unsigned int waiters;		/* sleepers, skip the wake if none */
+	int helpers;			/* holders are registered as helpers */
+	struct boost_obj *boost;	/* uboost backends */
+} pi_rwlock_t;
+
+int pi_rwlock_init(pi_rwlock_t *rw);
+
+void pi_rwlock_destroy(pi_rwlock_t *rw);
+
+/* 0, or EBUSY if the lock is taken (or, for readers, wanted) by a writer */
+int pi_rwlock_tryrdlock(pi_rwlock_t *rw);
+
+int pi_rwlock_trywrlock(pi_rwlock_t *rw);
+
+/* abstime (CLOCK_MONOTONIC) may be NULL; 0 or ETIMEDOUT */
+int pi_rwlock_timedrdlock(pi_rwlock_t *rw, const struct timespec *abstime);
+
+int pi_rwlock_timedwrlock(pi_rwlock_t *rw, const struct timespec *abstime);
+
+int pi_rwlock_rdlock(pi_rwlock_t *rw);
+
+int pi_rwlock_wrlock(pi_rwlock_t *rw);
+
+/* Either side, the lock word tells which */
+void pi_rwlock_unlock(pi_rwlock_t *rw);
+
+#endif /* __PI_RWLOCK__ */
@@ -0,0 +1,217 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include "dl_syscalls.h"
+#include "boost.h"
+#include "pi_sem.h"
+
+static int futex_wait(unsigned int *uaddr, unsigned int val,
+		      const struct timespec *abstime)
+{
+	return syscall(__NR_futex, uaddr,
+		       FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, val, abstime,
+		       NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+static int futex_wake(unsigned int *uaddr, int nr)
+{
+	return syscall(__NR_futex, uaddr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, nr,
+		       NULL, NULL, 0);
+}
+
+int pi_sem_init(pi_sem_t *s, unsigned int value)
+{
+	/* private futexes, and the engine is per process anyway */
+	assert(!sync_backend_is_shared());
+
+	memset(s, 0, sizeof(*s));
+	s->count = value;
+	if (!sync_backend->boost)
+		return 0;
+
+	s->boost = malloc(sizeof(*s->boost));
+	if (!s->boost)
+		return ENOMEM;
+	boost_obj_init(s->boost, BOOST_COND);
+
+	return 0;
+}
+
+void pi_sem_destroy(pi_sem_t *s)
+{
+	free(s->boost);
+	s->boost = NULL;
+}
+
+int pi_sem_trywait(pi_sem_t *s)
+{
+	unsigned int c = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+
+	while (c) {
+		if (__atomic_compare_exchange_n(&s->count, &c, c - 1, 0,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			return 0;
+	}
+
+	return EAGAIN;
+}
+
+int pi_sem_timedwait(pi_sem_t *s, const struct timespec *abstime)
+{
+	int ret = 0;
+
+	if (pi_sem_trywait(s) == 0)
+		return 0;
+
+	if (s->boost)
+		boost_block_timed(s->boost, abstime);
+	while (pi_sem_trywait(s) != 0) {
+		/*
+		 * Pairs with pi_sem_post(), which bumps the count before it
+		 * looks at waiters: either it sees us and wakes the futex,
+		 * or our futex_wait() sees the new count and returns.
+		 */
+		__atomic_add_fetch(&s->waiters, 1, __ATOMIC_SEQ_CST);
+		if (futex_wait(&s->count, 0, abstime) < 0 &&
+		    errno == ETIMEDOUT)
+			ret = ETIMEDOUT;
+		__atomic_sub_fetch(&s->waiters, 1, __ATOMIC_SEQ_CST);
+		if (ret)
+			break;
+	}
+	if (s->boost)
+		boost_unblock(s->boost);
+
+	return ret;
+}
+
+int pi_sem_wait(pi_sem_t *s)
+{
+	return pi_sem_timedwait(s, NULL);
+}
+
+void pi_sem_post(pi_sem_t *s)
+{
+	if (s->boost)
+		boost_signaled(s->boost);
+	/* count first, then waiters, see pi_sem_timedwait() */
+	__atomic_add_fetch(&s->count, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST))
+		futex_wake(&s->count, 1);
+}
+
+int pi_sem_helpers_add(pi_sem_t *s, pid_t pid)
+{
+	if (s->boost)
+		return boost_helpers_add(s->boost, pid);
+
+	return futex_helpers_add(&s->count, pid);
+}
+
+int pi_sem_helpers_del(pi_sem_t *s, pid_t pid)
+{
+	if (s->boost)
+		return boost_helpers_del(s->boost, pid);
+
+	return futex_helpers_del(&s->count, pid);
+}
+
+int pi_queue_init(pi_queue_t *q, unsigned int size, size_t elem_size)
+{
+	int ret;
+
+	assert(!sync_backend_is_shared());
+	memset(q, 0, sizeof(*q));
+	q->size = size;
+	q->elem_size = elem_size;
+	q->ring = malloc((size_t)size * elem_size);
+	if (!q->ring)
+		return ENOMEM;
+
+	ret = pi_sem_init(&q->items, 0);
+	if (!ret)
+		ret = pi_sem_init(&q->slots, size);
+	if (!ret)
+		ret = sync_mutex_init(&q->head_lock, 0);
+	if (!ret)
+		ret = sync_mutex_init(&q->tail_lock, 0);
+
+	return ret;
+}
+
+void pi_queue_destroy(pi_queue_t *q)
+{
+	sync_mutex_destroy(&q->tail_lock);
+	sync_mutex_destroy(&q->head_lock);
+	pi_sem_destroy(&q->slots);
+	pi_sem_destroy(&q->items);
+	free(q->ring);
+	q->ring = NULL;
+}
+
+/* A free slot is ours, fill it and publish it */
+void pi_queue_put(pi_queue_t *q, const void *elem)
+{
+	sync_mutex_lock(&q->tail_lock);
+	memcpy(q->ring + (size_t)q->tail * q->elem_size, elem, q->elem_size);
+	if (++q->tail == q->size)
+		q->tail = 0;
+	sync_mutex_unlock(&q->tail_lock);
+	pi_sem_post(&q->items);
+}
+
+/* A full slot is ours, empty it and give it back */
+void pi_queue_get(pi_queue_t *q, void *elem)
+{
+	sync_mutex_lock(&q->head_lock);
+	memcpy(elem, q->ring + (size_t)q->head * q->elem_size, q->elem_size);
+	if (++q->head == q->size)
+		q->head = 0;
+	sync_mutex_unlock(&q->head_lock);
+	pi_sem_post(&q->slots);
+}
+
+int pi_queue_push(pi_queue_t *q, const void *elem,
+		  const struct timespec *abstime)
+{
+	int ret = pi_sem_timedwait(&q->slots, abstime);
+
+	if (ret == 0)
+		pi_queue_put(q, elem);
+
+	return ret;
+}
+
+int pi_queue_pop(pi_queue_t *q, void *elem, const struct timespec *abstime)
+{
+	int ret = pi_sem_timedwait(&q->items, abstime);
+
+	if (ret == 0)
+		pi_queue_get(q, elem);
+
+	return ret;
+}
+
+int pi_queue_trypush(pi_queue_t *q, const void *elem)
+{
+	int ret = pi_sem_trywait(&q->slots);
+
+	if (ret == 0)
+		pi_queue_put(q, elem);
+
+	return ret;
+}
+
+int pi_queue_trypop(pi_queue_t *q, void *elem)
+{
+	int ret = pi_sem_trywait(&q->items);
+
+	if (ret == 0)
+		pi_queue_get(q, elem);
+
+	return ret;
+}
@@ -0,0 +1,87 @@
+/*
+ * PI-aware counting semaphore and bounded queue
+ *
+ * pi_sem_t is a futex counting semaphore: the count itself is the futex
+ * word, so post is one atomic add (plus a look at the sleepers count) and
+ * an uncontended wait one compare-and-swap; only an empty semaphore puts
+ * the waiter to sleep. Unlike sem_t a semaphore can have helpers, the
+ * threads expected to post it: they are boosted while somebody waits,
+ * by the kernel (FUTEX_COND_HELPER_MAN on the count) or in userspace with
+ * the uboost sync backends (libcv/boost.h).
+ *
+ * pi_queue_t is a bounded FIFO of fixed size elements on top of two
+ * semaphores, free slots and full slots. Producers and consumers then
+ * only contend among themselves, on two separate sync_mutex_t (PI with
+ * the pi backends) that protect the tail and head indices around the
+ * copy; the semaphores guarantee that the slot is there. Both have to
+ * be initialized after sync_backend_setup().
+ */
+
+#ifndef __PI_SEM__
+#define __PI_SEM__
+
+#include <sys/types.h>
+#include <time.h>
+#include "sync_backend.h"
+
+typedef struct pi_sem {
+	unsigned int count;		/* futex word */
+	unsigned int waiters;		/* sleepers, skip the wake if none */
+	struct boost_obj *boost;	/* uboost backends */
+} pi_sem_t;
+
+typedef struct pi_queue {
+	pi_sem_t items;			/* full slots, consumers wait here */
+	pi_sem_t slots;			/* free slots, producers wait here */
+	sync_mutex_t head_lock;
+	sync_mutex_t tail_lock;
+	unsigned int head;		/* next slot to pop */
+	unsigned int tail;		/* next slot to push */
+	unsigned int size;
+	size_t elem_size;
+	char *ring;
+} pi_queue_t;
+
+int pi_sem_init(pi_sem_t *s, unsigned int value);
+
+void pi_sem_destroy(pi_sem_t *s);
+
+/* 0, or EAGAIN if the count is 0 */
+int pi_sem_trywait(pi_sem_t *s);
+
+/* abstime (CLOCK_MONOTONIC) may be NULL; 0 or ETIMEDOUT */
+int pi_sem_timedwait(pi_sem_t *s, const struct timespec *abstime);
+
+int pi_sem_wait(pi_sem_t *s);
+
+void pi_sem_post(pi_sem_t *s);
+
+int pi_sem_helpers_add(pi_sem_t *s, pid_t pid);
+
+int pi_sem_helpers_del(pi_sem_t *s, pid_t pid);
+
+/* A queue of size elements of elem_size bytes; 0 or an errno */
+int pi_queue_init(pi_queue_t *q, unsigned int size, size_t elem_size);
+
+void pi_queue_destroy(pi_queue_t *q);
+
+/* Copy elem in (out), waiting for a free (full) slot until abstime */
+int pi_queue_push(pi_queue_t *q, const void *elem,
+		  const struct timespec *abstime);
+
+int pi_queue_pop(pi_queue_t *q, void *elem, const struct timespec *abstime);
+
+/* Never block: 0, or EAGAIN if the queue is full (empty) */
+int pi_queue_trypush(pi_queue_t *q, const void *elem);
+
+int pi_queue_trypop(pi_queue_t *q, void *elem);
+
+/*
+ * The second half of a push (pop), for callers that took the free (full)
+ * slot from q->slots (q->items) themselves.
+ */
+void pi_queue_put(pi_queue_t *q, const void *elem);
+
+void pi_queue_get(pi_queue_t *q, void *elem);
+
+#endif /* __PI_SEM__ */
@@ -0,0 +1,998 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include "dl_syscalls.h"
+#include "boost.h"
+#include "sync_backend.h"
+
+/* Lock word polls before the spin backend goes to sleep */
+#define SYNC_SPIN_LOOPS		1000
+
+/* Bounds of the adaptive spin, polls of the word */
+#define SYNC_ADAPT_MIN		100
+#define SYNC_ADAPT_MAX		20000
+
+/* Default uboost-auto learning window (usec) */
+#define SYNC_LEARN_WINDOW	100000
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()	__builtin_ia32_pause()
+#else
+#define cpu_relax()	__asm__ __volatile__("" ::: "memory")
+#endif
+
+/* Objects live in memory shared between processes, sync_backend_set_shared() */
+static int sync_shared;
+static int futex_private = FUTEX_PRIVATE_FLAG;
+
+/* Absolute CLOCK_MONOTONIC timeout, or NULL */
+static int futex_wait(unsigned int *uaddr, unsigned int val,
+		      const struct timespec *abstime)
+{
+	return syscall(__NR_futex, uaddr,
+		       FUTEX_WAIT_BITSET | futex_private, val, abstime,
+		       NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+static int futex_wake(unsigned int *uaddr, int nr)
+{
+	return syscall(__NR_futex, uaddr, FUTEX_WAKE | futex_private, nr,
+		       NULL, NULL, 0);
+}
+
+/* glibc */
+
+static int glibc_mutex_init(sync_mutex_t *m, int protocol, int ceiling)
+{
+	pthread_mutexattr_t attr;
+	int ret;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setprotocol(&attr, protocol);
+	if (sync_shared)
+		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	if (protocol == PTHREAD_PRIO_PROTECT) {
+		if (!ceiling)
+			ceiling = sched_get_priority_max(SCHED_FIFO);
+		pthread_mutexattr_setprioceiling(&attr, ceiling);
+	}
+	ret = pthread_mutex_init(&m->pm, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	return ret;
+}
+
+static int plain_mutex_init(sync_mutex_t *m, int ceiling)
+{
+	return glibc_mutex_init(m, PTHREAD_PRIO_NONE, 0);
+}
+
+static int pi_mutex_init(sync_mutex_t *m, int ceiling)
+{
+	return glibc_mutex_init(m, PTHREAD_PRIO_INHERIT, 0);
+}
+
+static int protect_mutex_init(sync_mutex_t *m, int ceiling)
+{
+	return glibc_mutex_init(m, PTHREAD_PRIO_PROTECT, ceiling);
+}
+
+static int glibc_mutex_destroy(sync_mutex_t *m)
+{
+	return pthread_mutex_destroy(&m->pm);
+}
+
+static int glibc_mutex_lock(sync_mutex_t *m)
+{
+	return pthread_mutex_lock(&m->pm);
+}
+
+static int glibc_mutex_unlock(sync_mutex_t *m)
+{
+	return pthread_mutex_unlock(&m->pm);
+}
+
+static int glibc_cond_init(sync_cond_t *c)
+{
+	pthread_condattr_t attr;
+	int ret;
+
+	/* timed waits use CLOCK_MONOTONIC, as the futex backends do */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	if (sync_shared)
+		pthread_condattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	ret = pthread_cond_init(&c->pc, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return ret;
+}
+
+static int glibc_cond_destroy(sync_cond_t *c)
+{
+	return pthread_cond_destroy(&c->pc);
+}
+
+static int glibc_cond_wait(sync_cond_t *c, sync_mutex_t *m)
+{
+	return pthread_cond_wait(&c->pc, &m->pm);
+}
+
+static int glibc_cond_timedwait(sync_cond_t *c, sync_mutex_t *m,
+				const struct timespec *abstime)
+{
+	return pthread_cond_timedwait(&c->pc, &m->pm, abstime);
+}
+
+static int glibc_cond_signal(sync_cond_t *c)
+{
+	return pthread_cond_signal(&c->pc);
+}
+
+static int glibc_cond_broadcast(sync_cond_t *c)
+{
+	return pthread_cond_broadcast(&c->pc);
+}
+
+static int glibc_helpers_add(sync_cond_t *c, pid_t pid)
+{
+	if (sync_shared)
+		return pthread_cond_helpers_add_shared(&c->pc, pid);
+
+	return pthread_cond_helpers_add(&c->pc, pid);
+}
+
+static int glibc_helpers_del(sync_cond_t *c, pid_t pid)
+{
+	if (sync_shared)
+		return pthread_cond_helpers_del_shared(&c->pc, pid);
+
+	return pthread_cond_helpers_del(&c->pc, pid);
+}
+
+static int no_helpers(sync_cond_t *c, pid_t pid)
+{
+	return 0;
+}
+
+/* futex */
+
+static int futex_mutex_init(sync_mutex_t *m, int ceiling)
+{
+	memset(m, 0, sizeof(*m));
+
+	return 0;
+}
+
+static int futex_mutex_destroy(sync_mutex_t *m)
+{
+	return 0;
+}
+
+static inline unsigned int cmpxchg(unsigned int *p, unsigned int old,
+				   unsigned int new)
+{
+	__atomic_compare_exchange_n(p, &old, new, 0, __ATOMIC_ACQUIRE,
+				    __ATOMIC_RELAXED);
+
+	return old;
+}
+
+static void futex_mutex_sleep(sync_mutex_t *m, unsigned int c)
+{
+	if (c != 2)
+		c = __atomic_exchange_n(&m->word, 2, __ATOMIC_ACQUIRE);
+	while (c != 0) {
+		futex_wait(&m->word, 2, NULL);
+		c = __atomic_exchange_n(&m->word, 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+static int futex_mutex_lock(sync_mutex_t *m)
+{
+	unsigned int c = cmpxchg(&m->word, 0, 1);
+
+	if (c)
+		futex_mutex_sleep(m, c);
+
+	return 0;
+}
+
+static int spin_mutex_lock(sync_mutex_t *m)
+{
+	unsigned int c = cmpxchg(&m->word, 0, 1);
+	int i;
+
+	for (i = 0; c && i < SYNC_SPIN_LOOPS; i++) {
+		cpu_relax();
+		if (__atomic_load_n(&m->word, __ATOMIC_RELAXED) == 0)
+			c = cmpxchg(&m->word, 0, 1);
+	}
+
+	if (c)
+		futex_mutex_sleep(m, c);
+
+	return 0;
+}
+
+static int futex_mutex_unlock(sync_mutex_t *m)
+{
+	if (__atomic_fetch_sub(&m->word, 1, __ATOMIC_RELEASE) != 1) {
+		__atomic_store_n(&m->word, 0, __ATOMIC_RELEASE);
+		futex_wake(&m->word, 1);
+	}
+
+	return 0;
+}
+
+static int futex_cond_init(sync_cond_t *c)
+{
+	memset(c, 0, sizeof(*c));
+
+	return 0;
+}
+
+static int futex_cond_destroy(sync_cond_t *c)
+{
+	return 0;
+}
+
+static int futex_cond_timedwait(sync_cond_t *c, sync_mutex_t *m,
+				const struct timespec *abstime)
+{
+	unsigned int seq = __atomic_load_n(&c->seq, __ATOMIC_SEQ_CST);
+	int ret = 0;
+
+	__atomic_add_fetch(&c->waiters, 1, __ATOMIC_SEQ_CST);
+	sync_backend->mutex_unlock(m);
+	if (futex_wait(&c->seq, seq, abstime) != 0 && errno == ETIMEDOUT)
+		ret = ETIMEDOUT;
+	__atomic_sub_fetch(&c->waiters, 1, __ATOMIC_SEQ_CST);
+	sync_backend->mutex_lock(m);
+
+	return ret;
+}
+
+static int futex_cond_wait(sync_cond_t *c, sync_mutex_t *m)
+{
+	return futex_cond_timedwait(c, m, NULL);
+}
+
+static int futex_cond_wake(sync_cond_t *c, int nr)
+{
+	/*
+	 * Pairs with the waiters increment in futex_cond_timedwait(): either we
+	 * see the sleeper, or its futex call sees the new sequence.
+	 */
+	__atomic_add_fetch(&c->seq, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&c->waiters, __ATOMIC_SEQ_CST))
+		futex_wake(&c->seq, nr);
+
+	return 0;
+}
+
+static int futex_cond_signal(sync_cond_t *c)
+{
+	return futex_cond_wake(c, 1);
+}
+
+static int futex_cond_broadcast(sync_cond_t *c)
+{
+	return futex_cond_wake(c, INT_MAX);
+}
+
+static int futex_cond_helpers_add(sync_cond_t *c, pid_t pid)
+{
+	if (sync_shared)
+		return futex_helpers_add_shared(&c->seq, pid);
+
+	return futex_helpers_add(&c->seq, pid);
+}
+
+static int futex_cond_helpers_del(sync_cond_t *c, pid_t pid)
+{
+	if (sync_shared)
+		return futex_helpers_del_shared(&c->seq, pid);
+
+	return futex_helpers_del(&c->seq, pid);
+}
+
+/* pi-requeue */
+
+static __thread pid_t self_tid;
+
+/* gettid() is a system call, and the PI futex word wants it every time */
+static unsigned int pi_futex_tid(void)
+{
+	if (!self_tid)
+		self_tid = gettid();
+
+	return self_tid;
+}
+
+static int pi_futex_mutex_lock(sync_mutex_t *m)
+{
+	if (cmpxchg(&m->word, 0, pi_futex_tid()) == 0)
+		return 0;
+
+	/* the kernel queues us by priority and boosts the owner */
+	while (syscall(__NR_futex, &m->word, FUTEX_LOCK_PI | futex_private,
+		       0, NULL, NULL, 0) != 0) {
+		if (errno != EINTR && errno != EAGAIN)
+			return errno;
+	}
+
+	return 0;
+}
+
+static int pi_futex_mutex_unlock(sync_mutex_t *m)
+{
+	unsigned int tid = pi_futex_tid();
+
+	/* FUTEX_WAITERS set, the kernel hands the lock over */
+	if (!__atomic_compare_exchange_n(&m->word, &tid, 0, 0,
+					 __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		syscall(__NR_futex, &m->word, FUTEX_UNLOCK_PI | futex_private,
+			0, NULL, NULL, 0);
+
+	return 0;
+}
+
+static int requeue_cond_timedwait(sync_cond_t *c, sync_mutex_t *m,
+				  const struct timespec *abstime)
+{
+	unsigned int seq = __atomic_load_n(&c->seq, __ATOMIC_SEQ_CST);
+	int ret = 0;
+
+	c->mutex = m;
+	__atomic_add_fetch(&c->waiters, 1, __ATOMIC_SEQ_CST);
+	pi_futex_mutex_unlock(m);
+	if (syscall(__NR_futex, &c->seq, FUTEX_WAIT_REQUEUE_PI | futex_private,
+		    seq, abstime, &m->word, 0) == 0) {
+		/* woken, or requeued and then handed m, as its owner */
+		__atomic_sub_fetch(&c->waiters, 1, __ATOMIC_SEQ_CST);
+		return 0;
+	}
+	if (errno == ETIMEDOUT)
+		ret = ETIMEDOUT;
+	__atomic_sub_fetch(&c->waiters, 1, __ATOMIC_SEQ_CST);
+	pi_futex_mutex_lock(m);
+
+	return ret;
+}
+
+static int requeue_cond_wait(sync_cond_t *c, sync_mutex_t *m)
+{
+	return requeue_cond_timedwait(c, m, NULL);
+}
+
+/*
+ * Wake the highest priority waiter, if it can take the mutex, and move
+ * nr_requeue others onto the mutex, where the kernel queues them by
+ * priority: a broadcast with the mutex held wakes nobody, and the unlock
+ * hands the mutex to one waiter at a time, highest priority first.
+ */
+static int requeue_cond_wake(sync_cond_t *c, int nr_requeue)
+{
+	unsigned int seq = __atomic_add_fetch(&c->seq, 1, __ATOMIC_SEQ_CST);
+
+	/* pairs with the waiters increment, as in futex_cond_wake() */
+	if (!__atomic_load_n(&c->waiters, __ATOMIC_SEQ_CST))
+		return 0;
+
+	while (syscall(__NR_futex, &c->seq,
+		       FUTEX_CMP_REQUEUE_PI | futex_private, 1,
+		       (void *)(long)nr_requeue, &c->mutex->word, seq) < 0) {
+		/* anything else leaves the waiters asleep, say so */
+		if (errno != EAGAIN)
+			return errno;
+		/* another signal moved seq on, requeue against it */
+		seq = __atomic_load_n(&c->seq, __ATOMIC_SEQ_CST);
+	}
+
+	return 0;
+}
+
+/* Kernels without requeue-PI reject the op even with nobody to move */
+static int requeue_setup(const char *arg)
+{
+	unsigned int seq = 0, word = 0;
+
+	if (arg)
+		return -1;
+
+	return syscall(__NR_futex, &seq,
+		       FUTEX_CMP_REQUEUE_PI | FUTEX_PRIVATE_FLAG, 1,
+		       (void *)0L, &word, 0) < 0 ? -1 : 0;
+}
+
+static int requeue_cond_signal(sync_cond_t *c)
+{
+	return requeue_cond_wake(c, 0);
+}
+
+static int requeue_cond_broadcast(sync_cond_t *c)
+{
+	return requeue_cond_wake(c, INT_MAX);
+}
+
+/* uboost */
+
+static int uboost_mutex_init(sync_mutex_t *m, int ceiling)
+{
+	m->boost = malloc(sizeof(*m->boost));
+	if (!m->boost)
+		return ENOMEM;
+	boost_obj_init(m->boost, BOOST_MUTEX);
+
+	return pi_mutex_init(m, ceiling);
+}
+
+static int uboost_mutex_destroy(sync_mutex_t *m)
+{
+	free(m->boost);
+	m->boost = NULL;
+
+	return glibc_mutex_destroy(m);
+}
+
+static int uboost_mutex_lock(sync_mutex_t *m)
+{
+	int ret;
+
+	if (pthread_mutex_trylock(&m->pm) == 0) {
+		boost_own(m->boost);
+		return 0;
+	}
+
+	boost_block(m->boost);
+	ret = pthread_mutex_lock(&m->pm);
+	boost_unblock(m->boost);
+	if (ret == 0)
+		boost_own(m->boost);
+
+	return ret;
+}
+
+static int uboost_mutex_unlock(sync_mutex_t *m)
+{
+	boost_disown(m->boost);
+
+	return pthread_mutex_unlock(&m->pm);
+}
+
+static int uboost_cond_init(sync_cond_t *c)
+{
+	c->boost = malloc(sizeof(*c->boost));
+	if (!c->boost)
+		return ENOMEM;
+	boost_obj_init(c->boost, BOOST_COND);
+
+	return glibc_cond_init(c);
+}
+
+static int uboost_cond_destroy(sync_cond_t *c)
+{
+	free(c->boost);
+	c->boost = NULL;
+
+	return glibc_cond_destroy(c);
+}
+
+static int uboost_cond_timedwait(sync_cond_t *c, sync_mutex_t *m,
+				 const struct timespec *abstime)
+{
+	int ret;
+
+	boost_disown(m->boost);
+	boost_block_timed(c->boost, abstime);
+	if (abstime)
+		ret = pthread_cond_timedwait(&c->pc, &m->pm, abstime);
+	else
+		ret = pthread_cond_wait(&c->pc, &m->pm);
+	boost_unblock(c->boost);
+	boost_own(m->boost);
+
+	return ret;
+}
+
+static int uboost_cond_wait(sync_cond_t *c, sync_mutex_t *m)
+{
+	return uboost_cond_timedwait(c, m, NULL);
+}
+
+static int uboost_cond_signal(sync_cond_t *c)
+{
+	boost_signaled(c->boost);
+
+	return pthread_cond_signal(&c->pc);
+}
+
+static int uboost_cond_broadcast(sync_cond_t *c)
+{
+	boost_signaled(c->boost);
+
+	return pthread_cond_broadcast(&c->pc);
+}
+
+static int uboost_helpers_add(sync_cond_t *c, pid_t pid)
+{
+	return boost_helpers_add(c->boost, pid);
+}
+
+static int uboost_helpers_del(sync_cond_t *c, pid_t pid)
+{
+	return boost_helpers_del(c->boost, pid);
+}
+
+static int uboost_group_init(sync_group_t *g)
+{
+	g->boost = malloc(sizeof(*g->boost));
+	if (!g->boost)
+		return ENOMEM;
+	boost_group_init(g->boost);
+
+	return 0;
+}
+
+static int uboost_group_destroy(sync_group_t *g)
+{
+	free(g->boost);
+	g->boost = NULL;
+
+	return 0;
+}
+
+static int uboost_group_add(sync_group_t *g, pid_t pid)
+{
+	return boost_group_add(g->boost, pid);
+}
+
+static int uboost_group_del(sync_group_t *g, pid_t pid)
+{
+	return boost_group_del(g->boost, pid);
+}
+
+static int uboost_group_attach(sync_group_t *g, sync_cond_t *c)
+{
+	return boost_group_attach(g->boost, c->boost);
+}
+
+static int uboost_group_detach(sync_group_t *g, sync_cond_t *c)
+{
+	return boost_group_detach(g->boost, c->boost);
+}
+
+/* uboost-auto[:WINDOW], WINDOW in usec */
+static int uboost_auto_setup(const char *arg)
+{
+	unsigned long window = SYNC_LEARN_WINDOW;
+	char *end;
+
+	if (arg) {
+		window = strtoul(arg, &end, 10);
+		if (end == arg || *end || !window)
+			return -1;
+	}
+	boost_set_learning(window * 1000ULL);
+
+	return 0;
+}
+
+static const sync_backend_t backends[] = {
+	{
+		.name = "plain",
+		.helpers = -1,
+		.mutex_init = plain_mutex_init,
+		.mutex_destroy = glibc_mutex_destroy,
+		.mutex_lock = glibc_mutex_lock,
+		.mutex_unlock = glibc_mutex_unlock,
+		.cond_init = glibc_cond_init,
+		.cond_destroy = glibc_cond_destroy,
+		.cond_wait = glibc_cond_wait,
+		.cond_timedwait = glibc_cond_timedwait,
+		.cond_signal = glibc_cond_signal,
+		.cond_broadcast = glibc_cond_broadcast,
+		.helpers_add = glibc_helpers_add,
+		.helpers_del = glibc_helpers_del,
+	},
+	{
+		.name = "pi",
+		.helpers = 0,
+		.mutex_init = pi_mutex_init,
+		.mutex_destroy = glibc_mutex_destroy,
+		.mutex_lock = glibc_mutex_lock,
+		.mutex_unlock = glibc_mutex_unlock,
+		.cond_init = glibc_cond_init,
+		.cond_destroy = glibc_cond_destroy,
+		.cond_wait = glibc_cond_wait,
+		.cond_timedwait = glibc_cond_timedwait,
+		.cond_signal = glibc_cond_signal,
+		.cond_broadcast = glibc_cond_broadcast,
+		.helpers_add = no_helpers,
+		.helpers_del = no_helpers,
+	},
+	{
+		.name = "pi-cond",
+		.helpers = 1,
+		.mutex_init = pi_mutex_init,
+		.mutex_destroy = glibc_mutex_destroy,
+		.mutex_lock = glibc_mutex_lock,
+		.mutex_unlock = glibc_mutex_unlock,
+		.cond_init = glibc_cond_init,
+		.cond_destroy = glibc_cond_destroy,
+		.cond_wait = glibc_cond_wait,
+		.cond_timedwait = glibc_cond_timedwait,
+		.cond_signal = glibc_cond_signal,
+		.cond_broadcast = glibc_cond_broadcast,
+		.helpers_add = glibc_helpers_add,
+		.helpers_del = glibc_helpers_del,
+	},
+	{
+		.name = "protect",
+		.helpers = 0,
+		.mutex_init = protect_mutex_init,
+		.mutex_destroy = glibc_mutex_destroy,
+		.mutex_lock = glibc_mutex_lock,
+		.mutex_unlock = glibc_mutex_unlock,
+		.cond_init = glibc_cond_init,
+		.cond_destroy = glibc_cond_destroy,
+		.cond_wait = glibc_cond_wait,
+		.cond_timedwait = glibc_cond_timedwait,
+		.cond_signal = glibc_cond_signal,
+		.cond_broadcast = glibc_cond_broadcast,
+		.helpers_add = no_helpers,
+		.helpers_del = no_helpers,
+	},
+	{
+		.name = "spin",
+		.helpers = -1,
+		.mutex_init = futex_mutex_init,
+		.mutex_destroy = futex_mutex_destroy,
+		.mutex_lock = spin_mutex_lock,
+		.mutex_unlock = futex_mutex_unlock,
+		.cond_init = futex_cond_init,
+		.cond_destroy = futex_cond_destroy,
+		.cond_wait = futex_cond_wait,
+		.cond_timedwait = futex_cond_timedwait,
+		.cond_signal = futex_cond_signal,
+		.cond_broadcast = futex_cond_broadcast,
+		.helpers_add = futex_cond_helpers_add,
+		.helpers_del = futex_cond_helpers_del,
+	},
+	{
+		.name = "futex",
+		.helpers = -1,
+		.mutex_init = futex_mutex_init,
+		.mutex_destroy = futex_mutex_destroy,
+		.mutex_lock = futex_mutex_lock,
+		.mutex_unlock = futex_mutex_unlock,
+		.cond_init = futex_cond_init,
+		.cond_destroy = futex_cond_destroy,
+		.cond_wait = futex_cond_wait,
+		.cond_timedwait = futex_cond_timedwait,
+		.cond_signal = futex_cond_signal,
+		.cond_broadcast = futex_cond_broadcast,
+		.helpers_add = futex_cond_helpers_add,
+		.helpers_del = futex_cond_helpers_del,
+	},
+	{
+		.name = "pi-requeue",
+		.helpers = -1,
+		.setup = requeue_setup,
+		.mutex_init = futex_mutex_init,
+		.mutex_destroy = futex_mutex_destroy,
+		.mutex_lock = pi_futex_mutex_lock,
+		.mutex_unlock = pi_futex_mutex_unlock,
+		.cond_init = futex_cond_init,
+		.cond_destroy = futex_cond_destroy,
+		.cond_wait = requeue_cond_wait,
+		.cond_timedwait = requeue_cond_timedwait,
+		.cond_signal = requeue_cond_signal,
+		.cond_broadcast = requeue_cond_broadcast,
+		.helpers_add = futex_cond_helpers_add,
+		.helpers_del = futex_cond_helpers_del,
+	},
+	{
+		.name = "uboost",
+		.helpers = 1,
+		.boost = 1,
+		.mutex_init = uboost_mutex_init,
+		.mutex_destroy = uboost_mutex_destroy,
+		.mutex_lock = uboost_mutex_lock,
+		.mutex_unlock = uboost_mutex_unlock,
+		.cond_init = uboost_cond_init,
+		.cond_destroy = uboost_cond_destroy,
+		.cond_wait = uboost_cond_wait,
+		.cond_timedwait = uboost_cond_timedwait,
+		.cond_signal = uboost_cond_signal,
+		.cond_broadcast = uboost_cond_broadcast,
+		.helpers_add = uboost_helpers_add,
+		.helpers_del = uboost_helpers_del,
+		.group_init = uboost_group_init,
+		.group_destroy = uboost_group_destroy,
+		.group_add = uboost_group_add,
+		.group_del = uboost_group_del,
+		.group_attach = uboost_group_attach,
+		.group_detach = uboost_group_detach,
+	},
+	{
+		.name = "uboost-auto",
+		.helpers = 0,
+		.boost = 1,
+		.setup = uboost_auto_setup,
+		.mutex_init = uboost_mutex_init,
+		.mutex_destroy = uboost_mutex_destroy,
+		.mutex_lock = uboost_mutex_lock,
+		.mutex_unlock = uboost_mutex_unlock,
+		.cond_init = uboost_cond_init,
+		.cond_destroy = uboost_cond_destroy,
+		.cond_wait = uboost_cond_wait,
+		.cond_timedwait = uboost_cond_timedwait,
+		.cond_signal = uboost_cond_signal,
+		.cond_broadcast = uboost_cond_broadcast,
+		.helpers_add = no_helpers,
+		.helpers_del = no_helpers,
+	},
+};
+
+#define NR_BACKENDS	(sizeof(backends) / sizeof(backends[0]))
+
+const sync_backend_t *sync_backend = &backends[0];
+
+static int sync_helpers;
+
+int sync_backend_setup(const char *name, int helpers)
+{
+	const char *arg;
+	unsigned int i;
+	size_t len;
+
+	if (!name)
+		name = getenv(SYNC_BACKEND_ENV);
+	if (!name || !*name)
+		name = helpers ? "pi-cond" : "pi";
+
+	arg = strchr(name, ':');
+	len = arg ? (size_t)(arg++ - name) : strlen(name);
+
+	for (i = 0; i < NR_BACKENDS; i++) {
+		if (strlen(backends[i].name) != len ||
+		    strncmp(name, backends[i].name, len) != 0)
+			continue;
+		if (backends[i].setup ? backends[i].setup(arg) != 0 : !!arg)
+			return -1;
+		sync_backend = &backends[i];
+		sync_helpers = sync_backend->helpers < 0 ?
+			       !!helpers : sync_backend->helpers;
+		return 0;
+	}
+
+	return -1;
+}
+
+int sync_helpers_enabled(void)
+{
+	return sync_helpers;
+}
+
+int sync_backend_set_shared(void)
+{
+	/* the engine state is per process, and so are the boost objects */
+	if (sync_backend->boost)
+		return -1;
+
+	sync_shared = 1;
+	futex_private = 0;
+
+	return 0;
+}
+
+int sync_backend_is_shared(void)
+{
+	return sync_shared;
+}
+
+const char *sync_backend_names(void)
+{
+	return "plain pi pi-cond protect spin futex pi-requeue uboost"
+	       " uboost-auto[:usec]";
+}
+
+/* Slot in on_cpu[] the busy thread counted itself in */
+static __thread int spin_slot;
+
+static int spin_cpu_slot(void)
+{
+	int cpu = sched_getcpu();
+
+	return cpu < 0 ? 0 : cpu % SYNC_SPIN_CPUS;
+}
+
+void sync_spin_init(sync_spin_t *s)
+{
+	memset(s, 0, sizeof(*s));
+}
+
+void sync_spin_busy(sync_spin_t *s)
+{
+	spin_slot = spin_cpu_slot();
+	__atomic_add_fetch(&s->on_cpu[spin_slot], 1, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&s->running, 1, __ATOMIC_SEQ_CST);
+}
+
+void sync_spin_idle(sync_spin_t *s)
+{
+	__atomic_sub_fetch(&s->running, 1, __ATOMIC_SEQ_CST);
+	__atomic_sub_fetch(&s->on_cpu[spin_slot], 1, __ATOMIC_SEQ_CST);
+}
+
+int sync_spin_wait(sync_spin_t *s, const int *word, int val)
+{
+	int i, limit, avg, *mine = &s->on_cpu[spin_cpu_slot()];
+
+	if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != val)
+		return 1;
+	/* nobody to wait for, or somebody we would keep off the CPU */
+	if (!__atomic_load_n(&s->running, __ATOMIC_SEQ_CST) ||
+	    __atomic_load_n(mine, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&s->skipped, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	/* racy updates of avg, it is only a hint */
+	avg = __atomic_load_n(&s->avg, __ATOMIC_RELAXED);
+	limit = 2 * avg + SYNC_ADAPT_MIN;
+	if (limit > SYNC_ADAPT_MAX)
+		limit = SYNC_ADAPT_MAX;
+	__atomic_add_fetch(&s->spins, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < limit; i++) {
+		cpu_relax();
+		if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != val) {
+			__atomic_add_fetch(&s->hits, 1, __ATOMIC_RELAXED);
+			__atomic_store_n(&s->avg, avg + (i - avg) / 8,
+					 __ATOMIC_RELAXED);
+			return 1;
+		}
+		/* whoever would change it went idle, or went busy here */
+		if (!__atomic_load_n(&s->running, __ATOMIC_RELAXED) ||
+		    __atomic_load_n(mine, __ATOMIC_RELAXED))
+			break;
+	}
+	/* wasted, spin less next time */
+	__atomic_store_n(&s->avg, avg - avg / 8, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/*
+ * Helper groups: the member and condvar lists are kept here in any case,
+ * so that backends without native groups can replay them through
+ * helpers_add/del.
+ */
+
+int sync_group_init(sync_group_t *g)
+{
+	int ret;
+
+	memset(g, 0, sizeof(*g));
+	ret = pthread_mutex_init(&g->lock, NULL);
+	if (ret == 0 && sync_backend->group_init)
+		ret = sync_backend->group_init(g);
+
+	return ret;
+}
+
+int sync_group_destroy(sync_group_t *g)
+{
+	while (g->nr_conds)
+		sync_group_detach(g, g->conds[0]);
+	/* or the members keep pointing at the native group */
+	while (g->nr_tids)
+		sync_group_del(g, g->tids[0]);
+	if (sync_backend->group_destroy)
+		sync_backend->group_destroy(g);
+
+	return pthread_mutex_destroy(&g->lock);
+}
+
+int sync_group_add(sync_group_t *g, pid_t pid)
+{
+	int i, ret = 0;
+
+	pthread_mutex_lock(&g->lock);
+	if (g->nr_tids == SYNC_GROUP_MAX) {
+		ret = EAGAIN;
+	} else if (sync_backend->group_add) {
+		ret = sync_backend->group_add(g, pid);
+	} else {
+		for (i = 0; i < g->nr_conds; i++) {
+			ret = sync_backend->helpers_add(g->conds[i], pid);
+			if (ret)
+				break;
+		}
+		while (ret && i--)
+			sync_backend->helpers_del(g->conds[i], pid);
+	}
+	if (ret == 0)
+		g->tids[g->nr_tids++] = pid;
+	pthread_mutex_unlock(&g->lock);
+
+	return ret;
+}
+
+int sync_group_del(sync_group_t *g, pid_t pid)
+{
+	int i, ret = ESRCH;
+
+	pthread_mutex_lock(&g->lock);
+	for (i = 0; i < g->nr_tids; i++) {
+		if (g->tids[i] == pid) {
+			g->tids[i] = g->tids[--g->nr_tids];
+			ret = 0;
+			break;
+		}
+	}
+	if (ret == 0 && sync_backend->group_del) {
+		ret = sync_backend->group_del(g, pid);
+	} else if (ret == 0) {
+		for (i = 0; i < g->nr_conds; i++)
+			sync_backend->helpers_del(g->conds[i], pid);
+	}
+	pthread_mutex_unlock(&g->lock);
+
+	return ret;
+}
+
+int sync_group_attach(sync_group_t *g, sync_cond_t *c)
+{
+	int i, ret = 0;
+
+	pthread_mutex_lock(&g->lock);
+	if (g->nr_conds == SYNC_GROUP_CONDS) {
+		ret = EAGAIN;
+	} else if (sync_backend->group_attach) {
+		ret = sync_backend->group_attach(g, c);
+	} else {
+		for (i = 0; i < g->nr_tids; i++) {
+			ret = sync_backend->helpers_add(c, g->tids[i]);
+			if (ret)
+				break;
+		}
+		while (ret && i--)
+			sync_backend->helpers_del(c, g->tids[i]);
+	}
+	if (ret == 0)
+		g->conds[g->nr_conds++] = c;
+	pthread_mutex_unlock(&g->lock);
+
+	return ret;
+}
+
+int sync_group_detach(sync_group_t *g, sync_cond_t *c)
+{
+	int i, ret = ESRCH;
+
+	pthread_mutex_lock(&g->lock);
+	for (i = 0; i < g->nr_conds; i++) {
+		if (g->conds[i] == c) {
+			g->conds[i] = g->conds[--g->nr_conds];
+			ret = 0;
+			break;
+		}
+	}
+	if (ret == 0 && sync_backend->group_detach) {
+		ret = sync_backend->group_detach(g, c);
+	} else if (ret == 0) {
+		for (i = 0; i < g->nr_tids; i++)
+			sync_backend->helpers_del(c, g->tids[i]);
+	}
+	pthread_mutex_unlock(&g->lock);
+
+	return ret;
+}
@@ -0,0 +1,259 @@
+/*
+ * Sync backends: swappable mutex/condvar implementations
+ *
+ * Test programs lock and wait through sync_mutex_t and sync_cond_t, and the
+ * actual implementation is picked once at startup, by name:
+ *
+ *   plain	glibc PTHREAD_PRIO_NONE mutex, glibc condvar, as the
+ *		original stress programs had
+ *   pi		glibc PTHREAD_PRIO_INHERIT mutex, glibc condvar
+ *   pi-cond	same, signalers registered as condvar helpers
+ *   protect	glibc PTHREAD_PRIO_PROTECT mutex, glibc condvar
+ *   spin	spin-then-futex mutex, futex condvar
+ *   futex	futex mutex, futex condvar
+ *   pi-requeue	PI futex mutex, condvar that morphs waits into mutex
+ *		waits: signal and broadcast requeue the waiters onto the
+ *		mutex (FUTEX_CMP_REQUEUE_PI), in priority order, instead
+ *		of waking them all to fight over it; not set up on kernels
+ *		without requeue-PI
+ *   uboost	glibc PI mutex and condvar, helpers boosted in userspace
+ *		(libcv/boost.h), transitively through mutex and condvar
+ *		chains
+ *   uboost-auto	same, but helpers are learned from the threads that
+ *		actually signal each condvar, within a window of usec
+ *		microseconds (uboost-auto:usec, 100ms by default)
+ *
+ * The futex mutex is the classic three state one (free, locked, contended),
+ * the spin variant polls the lock word for a while before sleeping on it.
+ * The futex condvar is a sequence word plus a waiter count, so signalling
+ * nobody costs no system call; pi-requeue waits on the same sequence word
+ * with FUTEX_WAIT_REQUEUE_PI, and the PI futex word is the owner's tid.
+ *
+ * Programs say where helpers would go (sync_cond_helpers_add()) and whether
+ * they want them; pi and protect never register helpers, pi-cond always
+ * does, plain and the futex backends follow the program. uboost-auto
+ * ignores the program's helpers altogether.
+ *
+ * A helper group (sync_group_t) is a set of threads registered as helpers
+ * of every condvar it is attached to. uboost has native groups; elsewhere
+ * group operations fall back on helpers_add/del, one call per member and
+ * condvar, which is what groups save the programs from writing out.
+ *
+ * Mutexes and condvars can also be shared between processes, see
+ * sync_backend_set_shared(); helper groups stay private to the process.
+ *
+ * Adaptive waiting (sync_spin_t): before parking on a condvar a waiter
+ * may poll the word it waits on for a while, as long as some thread that
+ * changes it is busy (between sync_spin_busy() and sync_spin_idle()) and
+ * none of those went busy on the waiter's CPU: no spinning in a single
+ * CPU run, nor against a thread the waiter would keep off its CPU. Busy
+ * is what the thread said, not what the scheduler did: one preempted,
+ * blocked on a mutex or migrated since still counts where it went busy,
+ * and a waiter may spin for nothing then. The bound follows the polls
+ * successful spins took, like glibc's adaptive mutexes do, so wasted
+ * spins soon get short.
+ */
+
+#ifndef __SYNC_BACKEND__
+#define __SYNC_BACKEND__
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define SYNC_BACKEND_ENV	"SYNC_BACKEND"
+
+#define SYNC_GROUP_MAX		256	/* threads in a helper group */
+#define SYNC_GROUP_CONDS	64	/* condvars a group is attached to */
+#define SYNC_SPIN_CPUS		64	/* CPUs busy threads are told apart
+					   on, the others alias */
+
+struct boost_obj;
+struct boost_group;
+
+typedef struct sync_mutex {
+	union {
+		pthread_mutex_t pm;	/* glibc backends */
+		unsigned int word;	/* futex: 0 free, 1 locked, 2 waiters */
+	};
+	struct boost_obj *boost;	/* uboost */
+} sync_mutex_t;
+
+typedef struct sync_cond {
+	union {
+		pthread_cond_t pc;	/* glibc backends */
+		struct {
+			unsigned int seq;	/* futex word */
+			unsigned int waiters;
+			struct sync_mutex *mutex;	/* pi-requeue target */
+		};
+	};
+	struct boost_obj *boost;	/* uboost */
+} sync_cond_t;
+
+typedef struct sync_group {
+	pthread_mutex_t lock;
+	pid_t tids[SYNC_GROUP_MAX];
+	int nr_tids;
+	sync_cond_t *conds[SYNC_GROUP_CONDS];
+	int nr_conds;
+	struct boost_group *boost;	/* uboost */
+} sync_group_t;
+
+typedef struct sync_spin {
+	int running;		/* threads about to change the word */
+	int on_cpu[SYNC_SPIN_CPUS];	/* ... by CPU they went busy on */
+	int avg;		/* polls a successful spin takes */
+	unsigned long spins;	/* waits that polled */
+	unsigned long hits;	/* ... and saw the word change */
+	unsigned long skipped;	/* waits that parked right away */
+} sync_spin_t;
+
+typedef struct sync_backend {
+	const char *name;
+	int helpers;		/* 1 always, 0 never, -1 as the program asks */
+	int boost;		/* objects are tracked by libcv/boost.h */
+	/* optional, gets what follows ':' in the name (or NULL) */
+	int (*setup)(const char *arg);
+	/* ceiling is only used by protect, 0 means the highest RT priority */
+	int (*mutex_init)(sync_mutex_t *m, int ceiling);
+	int (*mutex_destroy)(sync_mutex_t *m);
+	int (*mutex_lock)(sync_mutex_t *m);
+	int (*mutex_unlock)(sync_mutex_t *m);
+	int (*cond_init)(sync_cond_t *c);
+	int (*cond_destroy)(sync_cond_t *c);
+	int (*cond_wait)(sync_cond_t *c, sync_mutex_t *m);
+	/* absolute CLOCK_MONOTONIC timeout, returns ETIMEDOUT */
+	int (*cond_timedwait)(sync_cond_t *c, sync_mutex_t *m,
+			      const struct timespec *abstime);
+	int (*cond_signal)(sync_cond_t *c);
+	int (*cond_broadcast)(sync_cond_t *c);
+	int (*helpers_add)(sync_cond_t *c, pid_t pid);
+	int (*helpers_del)(sync_cond_t *c, pid_t pid);
+	/* native helper groups, optional */
+	int (*group_init)(sync_group_t *g);
+	int (*group_destroy)(sync_group_t *g);
+	int (*group_add)(sync_group_t *g, pid_t pid);
+	int (*group_del)(sync_group_t *g, pid_t pid);
+	int (*group_attach)(sync_group_t *g, sync_cond_t *c);
+	int (*group_detach)(sync_group_t *g, sync_cond_t *c);
+} sync_backend_t;
+
+extern const sync_backend_t *sync_backend;
+
+/*
+ * Select the backend: name, or $SYNC_BACKEND if name is NULL, or pi-cond
+ * / pi depending on helpers if neither is set. Must run before any object
+ * is initialized. Returns 0, -1 if the name (or its argument) is invalid.
+ */
+int sync_backend_setup(const char *name, int helpers);
+
+/* Whether the program should register helpers, after sync_backend_setup() */
+int sync_helpers_enabled(void);
+
+/*
+ * Objects initialized from now on may be placed in memory shared between
+ * processes: PTHREAD_PROCESS_SHARED glibc objects, non-private futexes
+ * and helper registrations. After sync_backend_setup(); -1 if the backend
+ * cannot (uboost, the engine is per process).
+ */
+int sync_backend_set_shared(void);
+
+/* Whether sync_backend_set_shared() was called */
+int sync_backend_is_shared(void);
+
+/* Space separated list of the backend names, for usage messages */
+const char *sync_backend_names(void);
+
+int sync_group_init(sync_group_t *g);
+
+int sync_group_destroy(sync_group_t *g);
+
+/* Membership changes apply to every condvar the group is attached to */
+int sync_group_add(sync_group_t *g, pid_t pid);
+
+int sync_group_del(sync_group_t *g, pid_t pid);
+
+int sync_group_attach(sync_group_t *g, sync_cond_t *c);
+
+int sync_group_detach(sync_group_t *g, sync_cond_t *c);
+
+void sync_spin_init(sync_spin_t *s);
+
+/*
+ * The calling thread is on its way to change the word, or no longer; a
+ * thread is busy on one sync_spin_t at a time.
+ */
+void sync_spin_busy(sync_spin_t *s);
+
+void sync_spin_idle(sync_spin_t *s);
+
+/*
+ * Poll *word while it is val and somebody busy runs elsewhere, up to the
+ * current bound: 1 if it changed, 0 if the caller has to park. Called
+ * without the lock that protects the word.
+ */
+int sync_spin_wait(sync_spin_t *s, const int *word, int val);
+
+static inline int sync_mutex_init(sync_mutex_t *m, int ceiling)
+{
+	return sync_backend->mutex_init(m, ceiling);
+}
+
+static inline int sync_mutex_destroy(sync_mutex_t *m)
+{
+	return sync_backend->mutex_destroy(m);
+}
+
+static inline int sync_mutex_lock(sync_mutex_t *m)
+{
+	return sync_backend->mutex_lock(m);
+}
+
+static inline int sync_mutex_unlock(sync_mutex_t *m)
+{
+	return sync_backend->mutex_unlock(m);
+}
+
+static inline int sync_cond_init(sync_cond_t *c)
+{
+	return sync_backend->cond_init(c);
+}
+
+static inline int sync_cond_destroy(sync_cond_t *c)
+{
+	return sync_backend->cond_destroy(c);
+}
+
+static inline int sync_cond_wait(sync_cond_t *c, sync_mutex_t *m)
+{
+	return sync_backend->cond_wait(c, m);
+}
+
+static inline int sync_cond_timedwait(sync_cond_t *c, sync_mutex_t *m,
+				      const struct timespec *abstime)
+{
+	return sync_backend->cond_timedwait(c, m, abstime);
+}
+
+static inline int sync_cond_signal(sync_cond_t *c)
+{
+	return sync_backend->cond_signal(c);
+}
+
+static inline int sync_cond_broadcast(sync_cond_t *c)
+{
+	return sync_backend->cond_broadcast(c);
+}
+
+static inline int sync_cond_helpers_add(sync_cond_t *c, pid_t pid)
+{
+	return sync_backend->helpers_add(c, pid);
+}
+
+static inline int sync_cond_helpers_del(sync_cond_t *c, pid_t pid)
+{
+	return sync_backend->helpers_del(c, pid);
+}
+
+#endif /* __SYNC_BACKEND__ */
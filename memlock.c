@@ -0,0 +1,99 @@
+/******************************************************************************
+* FILE: memlock.c
+* DESCRIPTION:
+*  Memory locking, prefaulting and fault accounting, see memlock.h.
+******************************************************************************/
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <sys/mman.h>
+#include "memlock.h"
+#include "rt-app_utils.h"
+
+int memlock_all(int onfault)
+{
+	int flags = MCL_CURRENT | MCL_FUTURE;
+
+	if (onfault) {
+#ifdef MCL_ONFAULT
+		flags |= MCL_ONFAULT;
+#else
+		log_notice("MCL_ONFAULT not available, locking everything");
+#endif
+	}
+
+	if (mlockall(flags) != 0) {
+		log_error("mlockall failed");
+		return 1;
+	}
+
+	return 0;
+}
+
+void prefault(void *addr, size_t len)
+{
+	volatile char *p = addr;
+	long page = sysconf(_SC_PAGESIZE);
+	size_t off;
+
+	if (!len)
+		return;
+
+	for (off = 0; off < len; off += page)
+		p[off] = p[off];
+	p[len - 1] = p[len - 1];
+}
+
+void *stack_setup(pthread_attr_t *attr, size_t *size, int huge)
+{
+	static int warned;
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_POPULATE;
+	void *stack = MAP_FAILED;
+	size_t len = *size;
+
+	if (huge) {
+		len = (len + MEMLOCK_HUGEPAGE - 1) & ~(MEMLOCK_HUGEPAGE - 1);
+		stack = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			     flags | MAP_HUGETLB, -1, 0);
+		if (stack == MAP_FAILED) {
+			if (!warned++)
+				log_notice("no huge pages for thread stacks,"
+					   " using normal pages");
+			len = *size;
+		}
+	}
+
+	if (stack == MAP_FAILED)
+		stack = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (stack == MAP_FAILED) {
+		log_error("cannot allocate thread stack");
+		return NULL;
+	}
+
+	/* MAP_POPULATE is only a hint for non locked mappings */
+	prefault(stack, len);
+
+	if (pthread_attr_setstack(attr, stack, len) != 0) {
+		log_error("pthread_attr_setstack failed");
+		munmap(stack, len);
+		return NULL;
+	}
+
+	*size = len;
+
+	return stack;
+}
+
+void stack_free(void *stack, size_t size)
+{
+	if (stack)
+		munmap(stack, size);
+}
+
+void faults_delta(const struct rusage *from, long *minflt, long *majflt)
+{
+	struct rusage now;
+
+	getrusage(RUSAGE_SELF, &now);
+	*minflt = now.ru_minflt - from->ru_minflt;
+	*majflt = now.ru_majflt - from->ru_majflt;
+}
@@ -0,0 +1,40 @@
+/******************************************************************************
+* FILE: memlock.h
+* DESCRIPTION:
+*  Keep page faults out of the measured window: lock the address space,
+*  prefault shared data and hand out pre-sized, populated thread stacks.
+******************************************************************************/
+#ifndef _MEMLOCK_H_
+#define _MEMLOCK_H_
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#define MEMLOCK_STACK_DEFAULT	(256 * 1024)
+#define MEMLOCK_HUGEPAGE	(2 * 1024 * 1024)
+
+/*
+ * mlockall() current and future mappings. With onfault set only pages that
+ * are already resident, or faulted in later, are locked: big read-only
+ * mappings (replay traces) are then not populated as a whole, and the
+ * caller is in charge of prefaulting whatever it touches while measuring.
+ */
+int memlock_all(int onfault);
+
+/* Write-touch every page in [addr, addr + len) */
+void prefault(void *addr, size_t len);
+
+/*
+ * Allocate a populated stack of (at least) size bytes, backed by huge pages
+ * if huge is set and the system has some available, and install it in
+ * attr. Returns the stack, to be released with stack_free(), or NULL.
+ */
+void *stack_setup(pthread_attr_t *attr, size_t *size, int huge);
+
+void stack_free(void *stack, size_t size);
+
+/* Minor and major faults taken by the process since *from */
+void faults_delta(const struct rusage *from, long *minflt, long *majflt);
+
+#endif /* _MEMLOCK_H_ */
@@ -0,0 +1,467 @@
+/******************************************************************************
+* FILE: mq_bench.c
+* DESCRIPTION:
+*  Consumers serving K queues. Producers put timestamped items on random
+*  queues at a fixed rate, and the items are taken out by:
+*
+*   waitv	one consumer sleeping on all the queues at once, mq_wait()
+*		on top of futex_waitv()
+*   group	same, with the single futex fallback of mq_wait()
+*   threads	one consumer per queue, blocked on the queue condvar
+*   poll	one consumer scanning all the queues, sleeping -y usec
+*		after every empty pass
+*
+*  The report gives the enqueue to dequeue latency, the CPU time burnt by
+*  the consumers and the futex syscalls per item.
+******************************************************************************/
+#define _GNU_SOURCE
+#include <sched.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "rt-app_utils.h"
+#include "rand_dist.h"
+#include "stats.h"
+#include "syscount.h"
+#include "libcv/dl_syscalls.h"
+#include "libcv/multi_wait.h"
+#include "libcv/sync_backend.h"
+
+#define MAX_QUEUES	64
+#define MAX_PROD	16
+#define QSIZE		64
+#define SHUTDOWN_POLL	100000000L	/* nsec, timed waits */
+
+typedef enum wait_mode_t
+{
+	MODE_WAITV = 0,
+	MODE_GROUP,
+	MODE_THREADS,
+	MODE_POLL
+} wait_mode_t;
+
+static const char *mode_names[] = { "waitv", "group", "threads", "poll" };
+
+struct global_args_t {
+	int nqueues;		/* -k # of queues */
+	wait_mode_t mode;	/* -m waitv, group, threads or poll */
+	int num_prod;		/* -p # of producers */
+	long interval;		/* -i usec between items, per producer */
+	long poll_sleep;	/* -y usec between empty polls */
+	int pi_cv_enabled;	/* -P producers help on every queue */
+	int duration;		/* -d duration (sec) */
+	unsigned long seed;	/* -s PRNG seed */
+	char *sync;		/* -B mutex/condvar backend */
+} global_args;
+
+static const char *opt_string = "k:m:p:i:y:Pd:s:B:";
+
+typedef struct {
+	unsigned long long ts[QSIZE];	/* enqueue time (nsec) */
+	int occupied;
+	int nextin;
+	int nextout;
+	sync_mutex_t mutex;
+	sync_cond_t more;
+	mq_event_t event;
+} queue_t;
+
+typedef struct {
+	unsigned long items;
+	unsigned long drops;	/* queue full, producers only */
+	unsigned long long cpu;	/* consumer CPU time (nsec) */
+	hist_t latency;
+} bench_stats_t;
+
+queue_t queues[MAX_QUEUES];
+mq_event_t *events[MAX_QUEUES];
+mq_wait_t wset;			/* waitv and group modes */
+bench_stats_t stats[MAX_QUEUES + MAX_PROD];
+volatile int shutdown = 0;
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return timespec_to_nsec(&now);
+}
+
+static struct timespec nsec_from_now(long nsec)
+{
+	struct timespec t, delta;
+
+	delta.tv_sec = nsec / 1000000000L;
+	delta.tv_nsec = nsec % 1000000000L;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return timespec_add(&t, &delta);
+}
+
+static void set_prio(int prio)
+{
+	struct sched_param param;
+
+	param.sched_priority = prio;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+		printf("pthread_setschedparam failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* Take every item out of q, returns how many */
+static int drain(queue_t *q, bench_stats_t *st)
+{
+	unsigned long long now;
+	int n = 0;
+
+	sync_mutex_lock(&q->mutex);
+	now = now_nsec();
+	while (q->occupied > 0) {
+		hist_add(&st->latency, now - q->ts[q->nextout++]);
+		q->nextout %= QSIZE;
+		q->occupied--;
+		n++;
+	}
+	sync_mutex_unlock(&q->mutex);
+	st->items += n;
+
+	return n;
+}
+
+static int drain_all(bench_stats_t *st)
+{
+	int i, n = 0;
+
+	/* unlocked peek: a racing put also changes the sampled events */
+	for (i = 0; i < global_args.nqueues; i++)
+		if (__atomic_load_n(&queues[i].occupied, __ATOMIC_ACQUIRE))
+			n += drain(&queues[i], st);
+
+	return n;
+}
+
+static void consumer_done(bench_stats_t *st)
+{
+	struct timespec cpu;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+	st->cpu = timespec_to_nsec(&cpu);
+}
+
+/* waitv and group modes */
+void *multi_consumer(void *d)
+{
+	bench_stats_t *st = &stats[0];
+	struct timespec timeout;
+
+	set_prio(94);
+
+	while (!shutdown) {
+		mq_wait_prepare(&wset);
+		if (drain_all(st))
+			continue;
+		timeout = nsec_from_now(SHUTDOWN_POLL);
+		mq_wait(&wset, &timeout);
+	}
+
+	consumer_done(st);
+	pthread_exit(NULL);
+}
+
+/* threads mode, one per queue */
+void *queue_consumer(void *d)
+{
+	long id = (long) d;
+	queue_t *q = &queues[id];
+	bench_stats_t *st = &stats[id];
+	struct timespec timeout;
+	unsigned long long now;
+
+	set_prio(94);
+
+	while (!shutdown) {
+		sync_mutex_lock(&q->mutex);
+		while (q->occupied <= 0 && !shutdown) {
+			timeout = nsec_from_now(SHUTDOWN_POLL);
+			sync_cond_timedwait(&q->more, &q->mutex, &timeout);
+		}
+		now = now_nsec();
+		while (q->occupied > 0) {
+			hist_add(&st->latency, now - q->ts[q->nextout++]);
+			q->nextout %= QSIZE;
+			q->occupied--;
+			st->items++;
+		}
+		sync_mutex_unlock(&q->mutex);
+	}
+
+	consumer_done(st);
+	pthread_exit(NULL);
+}
+
+/* poll mode */
+void *poll_consumer(void *d)
+{
+	bench_stats_t *st = &stats[0];
+	struct timespec nap = usec_to_timespec(global_args.poll_sleep);
+
+	set_prio(94);
+
+	while (!shutdown) {
+		if (!drain_all(st) && global_args.poll_sleep)
+			clock_nanosleep(CLOCK_MONOTONIC, 0, &nap, NULL);
+	}
+
+	consumer_done(st);
+	pthread_exit(NULL);
+}
+
+void *producer(void *d)
+{
+	long id = (long) d;
+	bench_stats_t *st = &stats[MAX_QUEUES + id];
+	struct timespec release, period;
+	struct rand_state rs;
+	queue_t *q;
+	pid_t my_pid = gettid();
+	int i;
+
+	rand_seed(&rs, global_args.seed, id);
+	set_prio(92);
+
+	if (global_args.pi_cv_enabled) {
+		for (i = 0; i < global_args.nqueues; i++) {
+			if (global_args.mode == MODE_THREADS)
+				sync_cond_helpers_add(&queues[i].more,
+						      my_pid);
+			else if (global_args.mode != MODE_POLL)
+				mq_event_helpers_add(&queues[i].event,
+						     my_pid);
+		}
+	}
+
+	period = usec_to_timespec(global_args.interval);
+	clock_gettime(CLOCK_MONOTONIC, &release);
+	while (!shutdown) {
+		release = timespec_add(&release, &period);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &release,
+				NULL);
+
+		q = &queues[rand_next(&rs) % global_args.nqueues];
+		sync_mutex_lock(&q->mutex);
+		if (q->occupied >= QSIZE) {
+			st->drops++;
+			sync_mutex_unlock(&q->mutex);
+			continue;
+		}
+		q->ts[q->nextin++] = now_nsec();
+		q->nextin %= QSIZE;
+		__atomic_store_n(&q->occupied, q->occupied + 1,
+				 __ATOMIC_RELEASE);
+		if (global_args.mode == MODE_THREADS)
+			sync_cond_signal(&q->more);
+		sync_mutex_unlock(&q->mutex);
+		st->items++;
+
+		if (global_args.mode == MODE_WAITV ||
+		    global_args.mode == MODE_GROUP)
+			mq_event_signal(&q->event);
+	}
+
+	if (global_args.pi_cv_enabled) {
+		for (i = 0; i < global_args.nqueues; i++) {
+			if (global_args.mode == MODE_THREADS)
+				sync_cond_helpers_del(&queues[i].more,
+						      my_pid);
+			else if (global_args.mode != MODE_POLL)
+				mq_event_helpers_del(&queues[i].event,
+						     my_pid);
+		}
+	}
+
+	pthread_exit(NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, opt, nthreads = 0, ncons;
+	pthread_t threads[MAX_QUEUES + MAX_PROD];
+	struct sched_param param;
+	struct timespec t_start, t_end;
+	static hist_t latency;
+	unsigned long produced = 0, consumed = 0, drops = 0;
+	unsigned long long cpu = 0;
+	long long futexes;
+	double secs;
+	int futex_fd;
+
+	global_args.nqueues = 4;
+	global_args.mode = MODE_WAITV;
+	global_args.num_prod = 2;
+	global_args.interval = 1000;
+	global_args.poll_sleep = 100;
+	global_args.duration = 10;
+	global_args.seed = time(NULL);
+
+	while ((opt = getopt(argc, argv, opt_string)) != -1) {
+		switch (opt) {
+		case 'k':
+			global_args.nqueues = atoi(optarg);
+			break;
+		case 'm':
+			for (i = 0; i <= MODE_POLL; i++)
+				if (strcmp(optarg, mode_names[i]) == 0)
+					break;
+			if (i > MODE_POLL) {
+				printf("invalid mode %s\n", optarg);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			global_args.mode = i;
+			break;
+		case 'p':
+			global_args.num_prod = atoi(optarg);
+			break;
+		case 'i':
+			global_args.interval = atol(optarg);
+			break;
+		case 'y':
+			global_args.poll_sleep = atol(optarg);
+			break;
+		case 'P':
+			global_args.pi_cv_enabled = 1;
+			break;
+		case 'd':
+			global_args.duration = atoi(optarg);
+			break;
+		case 's':
+			global_args.seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			global_args.sync = optarg;
+			break;
+		}
+	}
+
+	if (global_args.nqueues < 1 || global_args.nqueues > MAX_QUEUES ||
+	    global_args.num_prod < 1 || global_args.num_prod > MAX_PROD ||
+	    global_args.interval <= 0) {
+		printf("invalid queues, producers or interval\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (sync_backend_setup(global_args.sync, global_args.pi_cv_enabled)) {
+		printf("invalid sync backend %s, one of: %s\n",
+		       global_args.sync, sync_backend_names());
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	/* condvar helpers are up to the sync backend */
+	if (global_args.mode == MODE_THREADS)
+		global_args.pi_cv_enabled = sync_helpers_enabled();
+	/* event helpers are kernel ones, the engine never sees the events */
+	if (global_args.pi_cv_enabled && global_args.mode != MODE_THREADS &&
+	    sync_backend->boost) {
+		printf("-P needs -m threads with the %s sync backend\n",
+		       sync_backend->name);
+		exit(EXIT_INV_COMMANDLINE);
+	}
+
+	param.sched_priority = 99;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+		printf("pthread_setschedparam failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < global_args.nqueues; i++) {
+		sync_mutex_init(&queues[i].mutex, 0);
+		sync_cond_init(&queues[i].more);
+		mq_event_init(&queues[i].event);
+		events[i] = &queues[i].event;
+	}
+	/*
+	 * Before any thread: the producers register their helpers on the
+	 * group word too, so they must see it.
+	 */
+	if ((global_args.mode == MODE_WAITV ||
+	     global_args.mode == MODE_GROUP) &&
+	    mq_wait_init(&wset, events, global_args.nqueues,
+			 global_args.mode == MODE_GROUP ?
+			 MQ_WAIT_NO_WAITV : 0)) {
+		printf("mq_wait_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+	if (global_args.mode == MODE_WAITV && !wset.use_waitv)
+		printf("futex_waitv not available, using the fallback\n");
+	for (i = 0; i < MAX_QUEUES + MAX_PROD; i++)
+		hist_init(&stats[i].latency);
+
+	printf("Main(): %s, %d queues, %d producers every %ld usec%s,"
+	       " %s sync backend\n", mode_names[global_args.mode],
+	       global_args.nqueues, global_args.num_prod,
+	       global_args.interval,
+	       global_args.pi_cv_enabled ? ", helpers" : "",
+	       sync_backend->name);
+
+	/* opened before any thread is created, so that they inherit it */
+	futex_fd = syscount_open("futex");
+
+	ncons = global_args.mode == MODE_THREADS ? global_args.nqueues : 1;
+	for (i = 0; i < ncons; i++)
+		pthread_create(&threads[nthreads++], NULL,
+			       global_args.mode == MODE_THREADS ?
+			       queue_consumer :
+			       global_args.mode == MODE_POLL ?
+			       poll_consumer : multi_consumer,
+			       (void *)(long)i);
+	for (i = 0; i < global_args.num_prod; i++)
+		pthread_create(&threads[nthreads++], NULL, producer,
+			       (void *)(long)i);
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	sleep(global_args.duration);
+	shutdown = 1;
+	futexes = syscount_read(futex_fd);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	if (global_args.mode == MODE_WAITV || global_args.mode == MODE_GROUP)
+		mq_wait_destroy(&wset);
+
+	hist_init(&latency);
+	for (i = 0; i < ncons; i++) {
+		consumed += stats[i].items;
+		cpu += stats[i].cpu;
+		hist_merge(&latency, &stats[i].latency);
+	}
+	for (i = 0; i < global_args.num_prod; i++) {
+		produced += stats[MAX_QUEUES + i].items;
+		drops += stats[MAX_QUEUES + i].drops;
+	}
+
+	secs = (timespec_to_nsec(&t_end) - timespec_to_nsec(&t_start)) / 1E9;
+	printf("%s K=%d: %lu produced, %lu consumed, %lu dropped,"
+	       " %.1f items/sec\n", mode_names[global_args.mode],
+	       global_args.nqueues, produced, consumed, drops,
+	       consumed / secs);
+	printf("  consumer cpu %.2f%%, %.0f nsec/item\n",
+	       100.0 * cpu / (secs * 1E9), consumed ? (double)cpu / consumed :
+	       0.0);
+	hist_print(stdout, "  enqueue to dequeue", &latency);
+	if (futexes < 0)
+		printf("  futex syscalls: n/a\n");
+	else
+		printf("  futex syscalls: %lld, %.3f per item\n", futexes,
+		       consumed ? (double)futexes / consumed : 0.0);
+
+	syscount_close(futex_fd);
+	for (i = 0; i < global_args.nqueues; i++) {
+		sync_mutex_destroy(&queues[i].mutex);
+		sync_cond_destroy(&queues[i].more);
+	}
+
+	return 0;
+}
@@ -0,0 +1,240 @@
+/******************************************************************************
+* FILE: notify.c
+* DESCRIPTION:
+*  Condition notification backends, see notify.h.
+******************************************************************************/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <linux/futex.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "notify.h"
+#include "rt-app_utils.h"
+#include "libcv/dl_syscalls.h"
+
+static const char *notify_names[NOTIFY_NR] = { "cond", "pi-cond", "futex",
+					       "eventfd" };
+
+int notify_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NOTIFY_NR; i++)
+		if (strcmp(name, notify_names[i]) == 0)
+			return i;
+
+	return -1;
+}
+
+const char *notify_name(notify_kind_t kind)
+{
+	return notify_names[kind];
+}
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return timespec_to_nsec(&now);
+}
+
+int notify_init(notify_t *n, notify_kind_t kind)
+{
+	struct epoll_event ev;
+
+	memset(n, 0, sizeof(*n));
+	n->kind = kind;
+	n->efd = n->epfd = -1;
+
+	switch (kind) {
+	case NOTIFY_COND:
+	case NOTIFY_PI_COND:
+		return sync_cond_init(&n->cond);
+	case NOTIFY_FUTEX:
+		return 0;
+	case NOTIFY_EVENTFD:
+		n->efd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK);
+		n->epfd = epoll_create1(0);
+		if (n->efd < 0 || n->epfd < 0) {
+			log_error("cannot create eventfd/epoll");
+			notify_destroy(n);
+			return 1;
+		}
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		if (epoll_ctl(n->epfd, EPOLL_CTL_ADD, n->efd, &ev) != 0) {
+			log_error("cannot add eventfd to epoll");
+			notify_destroy(n);
+			return 1;
+		}
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+void notify_destroy(notify_t *n)
+{
+	if (n->kind == NOTIFY_COND || n->kind == NOTIFY_PI_COND)
+		sync_cond_destroy(&n->cond);
+	if (n->efd >= 0)
+		close(n->efd);
+	if (n->epfd >= 0)
+		close(n->epfd);
+	n->efd = n->epfd = -1;
+}
+
+static int futex_wait(notify_t *n, sync_mutex_t *m,
+		      const struct timespec *abstime)
+{
+	unsigned int seq = n->seq;
+	int ret = 0;
+
+	sync_mutex_unlock(m);
+	if (syscall(__NR_futex, &n->seq,
+		    FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, seq, abstime, NULL,
+		    FUTEX_BITSET_MATCH_ANY) != 0 && errno == ETIMEDOUT)
+		ret = ETIMEDOUT;
+	sync_mutex_lock(m);
+
+	return ret;
+}
+
+/* Milliseconds left until abstime, rounded up; -1 forever */
+static int eventfd_timeout(const struct timespec *abstime)
+{
+	unsigned long long now = now_nsec(), end;
+
+	if (!abstime)
+		return -1;
+	end = abstime->tv_sec * 1000000000ULL + abstime->tv_nsec;
+
+	return end > now ? (end - now + 999999) / 1000000 : 0;
+}
+
+static int eventfd_wait(notify_t *n, sync_mutex_t *m,
+			const struct timespec *abstime)
+{
+	struct epoll_event ev;
+	uint64_t val;
+	int ret = 0, ms;
+
+	sync_mutex_unlock(m);
+	/* another waiter may take the count first, then just go back */
+	while (read(n->efd, &val, sizeof(val)) != sizeof(val)) {
+		if (errno != EAGAIN)
+			break;
+		ms = eventfd_timeout(abstime);
+		if (ms == 0) {
+			ret = ETIMEDOUT;
+			break;
+		}
+		epoll_wait(n->epfd, &ev, 1, ms);
+	}
+	sync_mutex_lock(m);
+
+	return ret;
+}
+
+unsigned long long notify_wait(notify_t *n, sync_mutex_t *m)
+{
+	return notify_timedwait(n, m, NULL, NULL);
+}
+
+unsigned long long notify_timedwait(notify_t *n, sync_mutex_t *m,
+				    const struct timespec *abstime,
+				    int *timedout)
+{
+	unsigned long long start = now_nsec(), signaled;
+	int ret = 0;
+
+	n->waiters++;
+	switch (n->kind) {
+	case NOTIFY_COND:
+	case NOTIFY_PI_COND:
+		if (abstime)
+			ret = sync_cond_timedwait(&n->cond, m, abstime);
+		else
+			sync_cond_wait(&n->cond, m);
+		break;
+	case NOTIFY_FUTEX:
+		ret = futex_wait(n, m, abstime);
+		break;
+	case NOTIFY_EVENTFD:
+		ret = eventfd_wait(n, m, abstime);
+		break;
+	default:
+		break;
+	}
+	n->waiters--;
+
+	if (ret == ETIMEDOUT) {
+		if (timedout)
+			*timedout = 1;
+		return 0;
+	}
+
+	signaled = n->signaled;
+	if (signaled < start)
+		return 0;
+
+	return now_nsec() - signaled;
+}
+
+void notify_signal(notify_t *n)
+{
+	uint64_t one = 1;
+
+	n->signaled = now_nsec();
+
+	switch (n->kind) {
+	case NOTIFY_COND:
+	case NOTIFY_PI_COND:
+		sync_cond_signal(&n->cond);
+		break;
+	case NOTIFY_FUTEX:
+		n->seq++;
+		if (n->waiters)
+			syscall(__NR_futex, &n->seq,
+				FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL, NULL,
+				0);
+		break;
+	case NOTIFY_EVENTFD:
+		if (n->waiters && write(n->efd, &one, sizeof(one)) < 0)
+			log_error("eventfd write failed");
+		break;
+	default:
+		break;
+	}
+}
+
+int notify_helpers_add(notify_t *n, pid_t pid)
+{
+	switch (n->kind) {
+	case NOTIFY_COND:
+	case NOTIFY_PI_COND:
+		return sync_cond_helpers_add(&n->cond, pid);
+	case NOTIFY_FUTEX:
+		return futex_helpers_add(&n->seq, pid);
+	default:
+		return -1;
+	}
+}
+
+int notify_helpers_del(notify_t *n, pid_t pid)
+{
+	switch (n->kind) {
+	case NOTIFY_COND:
+	case NOTIFY_PI_COND:
+		return sync_cond_helpers_del(&n->cond, pid);
+	case NOTIFY_FUTEX:
+		return futex_helpers_del(&n->seq, pid);
+	default:
+		return -1;
+	}
+}
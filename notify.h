@@ -0,0 +1,75 @@
+/******************************************************************************
+* FILE: notify.h
+* DESCRIPTION:
+*  Condition notification backends for the prod_cons buffer, with the
+*  semantics of a condition variable (wait drops and retakes the mutex,
+*  spurious wakeups are allowed):
+*
+*   cond	condvar of the sync backend (libcv/sync_backend.h)
+*   pi-cond	same, producers registered as helpers (what -P does)
+*   futex	a sequence word and FUTEX_WAIT/FUTEX_WAKE
+*   eventfd	a semaphore eventfd, waited for with epoll_wait()
+*
+*  Waiters are counted under the mutex, so the futex and eventfd backends
+*  only enter the kernel on signal when somebody actually sleeps. Every
+*  signal is timestamped, and notify_wait() returns how long ago the
+*  signal that woke the caller was sent.
+******************************************************************************/
+#ifndef _NOTIFY_H_
+#define _NOTIFY_H_
+
+#include <sys/types.h>
+#include <time.h>
+#include "libcv/sync_backend.h"
+
+typedef enum notify_kind_t
+{
+	NOTIFY_COND = 0,
+	NOTIFY_PI_COND,
+	NOTIFY_FUTEX,
+	NOTIFY_EVENTFD,
+	NOTIFY_NR
+} notify_kind_t;
+
+typedef struct _notify_t {
+	notify_kind_t kind;
+	sync_cond_t cond;
+	unsigned int seq;		/* futex word */
+	int efd;			/* eventfd, semaphore mode */
+	int epfd;
+	int waiters;			/* protected by the caller's mutex */
+	unsigned long long signaled;	/* last signal (nsec, monotonic) */
+} notify_t;
+
+/* Backend by name, -1 if unknown */
+int notify_parse(const char *name);
+
+const char *notify_name(notify_kind_t kind);
+
+int notify_init(notify_t *n, notify_kind_t kind);
+
+void notify_destroy(notify_t *n);
+
+/*
+ * Called with m held, returns with m held. Returns the time (nsec) from
+ * the signal to the caller owning m again, 0 for a spurious wakeup.
+ */
+unsigned long long notify_wait(notify_t *n, sync_mutex_t *m);
+
+/*
+ * Same, giving up at abstime (CLOCK_MONOTONIC, NULL waits forever): then
+ * *timedout is set and 0 is returned.
+ */
+unsigned long long notify_timedwait(notify_t *n, sync_mutex_t *m,
+				    const struct timespec *abstime,
+				    int *timedout);
+
+/* Called with the mutex held */
+void notify_signal(notify_t *n);
+
+/* PI-cond helpers, on the condvar or the futex word; -1 for eventfd */
+int notify_helpers_add(notify_t *n, pid_t pid);
+
+int notify_helpers_del(notify_t *n, pid_t pid);
+
+#endif /* _NOTIFY_H_ */
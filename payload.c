@@ -0,0 +1,83 @@
+/******************************************************************************
+* FILE: payload.c
+* DESCRIPTION:
+*  Payload slabs, see payload.h.
+******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "payload.h"
+#include "rt-app_utils.h"
+
+int slab_init(slab_t *s, int nslots)
+{
+	memset(s, 0, sizeof(*s));
+
+	s->mem = mmap(NULL, (size_t)nslots * PAYLOAD_MAX,
+		      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		      -1, 0);
+	if (s->mem == MAP_FAILED) {
+		s->mem = NULL;
+		log_error("cannot allocate payload slab");
+		return 1;
+	}
+
+	s->busy = calloc(nslots, sizeof(*s->busy));
+	if (!s->busy) {
+		log_error("cannot allocate payload slab");
+		slab_destroy(s);
+		return 1;
+	}
+	s->nslots = nslots;
+
+	return 0;
+}
+
+void slab_destroy(slab_t *s)
+{
+	if (s->mem)
+		munmap(s->mem, (size_t)s->nslots * PAYLOAD_MAX);
+	free(s->busy);
+	memset(s, 0, sizeof(*s));
+}
+
+int slab_get(slab_t *s)
+{
+	int i, slot;
+
+	for (i = 0; i < s->nslots; i++) {
+		slot = (s->next + i) % s->nslots;
+		/* pairs with the release in slab_put() */
+		if (!__atomic_load_n(&s->busy[slot], __ATOMIC_ACQUIRE)) {
+			s->busy[slot] = 1;
+			s->next = (slot + 1) % s->nslots;
+			return slot;
+		}
+	}
+
+	return -1;
+}
+
+void slab_put(slab_t *s, int slot)
+{
+	__atomic_store_n(&s->busy[slot], 0, __ATOMIC_RELEASE);
+}
+
+void payload_fill(char *p, size_t len, unsigned int seed)
+{
+	memset(p, seed & 0xff, len);
+}
+
+unsigned long payload_sum(const char *p, size_t len)
+{
+	const unsigned long *w = (const unsigned long *)p;
+	unsigned long sum = 0;
+	size_t i;
+
+	for (i = 0; i < len / sizeof(*w); i++)
+		sum += w[i];
+	for (i *= sizeof(*w); i < len; i++)
+		sum += (unsigned char)p[i];
+
+	return sum;
+}
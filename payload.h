@@ -0,0 +1,46 @@
+/******************************************************************************
+* FILE: payload.h
+* DESCRIPTION:
+*  Variable size message payloads carved out of a preallocated, per producer
+*  slab, so that only a descriptor has to go through the shared buffer.
+*
+*  Each slot is owned by the producer while it fills it, by the consumer
+*  that dequeued its descriptor afterwards, and goes back to the producer
+*  with slab_put(). Nothing is allocated or freed after slab_init().
+******************************************************************************/
+#ifndef _PAYLOAD_H_
+#define _PAYLOAD_H_
+
+#include <stddef.h>
+
+#define PAYLOAD_MIN	64
+#define PAYLOAD_MAX	(64 * 1024)
+
+typedef struct {
+	char *mem;		/* nslots * PAYLOAD_MAX bytes */
+	int *busy;		/* slot handed out, cleared by slab_put() */
+	int nslots;
+	int next;		/* where the owner starts looking, owner only */
+} slab_t;
+
+int slab_init(slab_t *s, int nslots);
+void slab_destroy(slab_t *s);
+
+/* Owner only: a free slot, or -1 if all of them are in flight */
+int slab_get(slab_t *s);
+
+/* Any thread: give slot back to the owner */
+void slab_put(slab_t *s, int slot);
+
+static inline char *slab_ptr(slab_t *s, int slot)
+{
+	return s->mem + (size_t)slot * PAYLOAD_MAX;
+}
+
+/* Write len bytes of a pattern depending on seed (producer side) */
+void payload_fill(char *p, size_t len, unsigned int seed);
+
+/* Read back len bytes (consumer side) */
+unsigned long payload_sum(const char *p, size_t len);
+
+#endif /* _PAYLOAD_H_ */
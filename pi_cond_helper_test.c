@@ -13,13 +13,13 @@
 #include <stdlib.h>
 #include "rt-app_utils.h"
 #include "libcv/dl_syscalls.h"
+#include "libcv/sync_backend.h"
 
 int count = 0;
-pthread_cond_t count_threshold_cv;
+sync_cond_t count_threshold_cv;
 
 void *helper(void *t) 
 {
-	int ret;
 	long my_id = (long)t;
 	pid_t my_pid = gettid();
 
@@ -27,7 +27,7 @@ void *helper(void *t)
 	
 	/* Adds itself to the helpers list. */
 	printf("helper(): thread %ld is going to be an helper...\n", my_id);
-	pthread_cond_helpers_add(&count_threshold_cv, my_pid);
+	sync_cond_helpers_add(&count_threshold_cv, my_pid);
 	printf("helper() [thread %ld]: I'm an helper!\n", my_id);
 
 	sleep(2);
@@ -35,7 +35,7 @@ void *helper(void *t)
 	/* Removes itself from the helpers list. */
 	printf("helper(): thread %ld is going to not be an helper anymore ...\n",
 	       my_id);
-	pthread_cond_helpers_del(&count_threshold_cv, my_pid);
+	sync_cond_helpers_del(&count_threshold_cv, my_pid);
 	printf("helper() [thread %ld]: I'm not an helper anymore!\n", my_id);
 
 
@@ -44,13 +44,19 @@ void *helper(void *t)
 
 int main(int argc, char *argv[])
 {
-	int i, rc, ret; 
-	long t1=1, t2=2, t3=3;
+	long t1=1;
 	pthread_t thread;
 	pthread_attr_t attr;
 	
+	if (sync_backend_setup(NULL, 1)) {
+		printf("invalid %s, one of: %s\n", SYNC_BACKEND_ENV,
+		       sync_backend_names());
+		exit(EXIT_FAILURE);
+	}
+	printf("Main(): %s sync backend\n", sync_backend->name);
+
 	/* Initialize condition variable object */
-	pthread_cond_init (&count_threshold_cv, NULL);
+	sync_cond_init(&count_threshold_cv);
 	
 	/* For portability, explicitly create threads in a joinable state */
 	pthread_attr_init(&attr);
@@ -62,6 +68,6 @@ int main(int argc, char *argv[])
 	
 	/* Clean up and exit */
 	pthread_attr_destroy(&attr);
-	pthread_cond_destroy(&count_threshold_cv);
+	sync_cond_destroy(&count_threshold_cv);
 	pthread_exit (NULL);
 }
@@ -13,14 +13,15 @@
 #include <stdlib.h>
 #include "rt-app_utils.h"
 #include "libcv/dl_syscalls.h"
+#include "libcv/sync_backend.h"
 
 #define NUM_THREADS  3
 
 int count = 0;
-pthread_mutex_t count_mutex;
-pthread_cond_t count_threshold_cv;
+sync_mutex_t count_mutex;
+sync_cond_t count_threshold_cv;
 
-static inline busywait(struct timespec *to)
+static inline void busywait(struct timespec *to)
 {
 	struct timespec t_step;
 	while (1) {
@@ -32,7 +33,7 @@ static inline busywait(struct timespec *to)
 
 void *inc_count(void *t) 
 {
-	int i, ret;
+	int ret;
 	long my_id = (long)t;
 	struct timespec twait;
 	struct sched_param param;
@@ -57,12 +58,12 @@ void *inc_count(void *t)
 	}
 
 	printf("Adding helper thread: thread %ld prio 93 pid %d\n", my_id, my_pid);
-	pthread_cond_helpers_add(&count_threshold_cv, my_pid);
+	sync_cond_helpers_add(&count_threshold_cv, my_pid);
 	sleep(2);
 
 	printf("Starting inc_count(): thread %ld prio 93\n", my_id);
 	
-	pthread_mutex_lock(&count_mutex);
+	sync_mutex_lock(&count_mutex);
 
 	/* Do some work (e.g., fill up the queue) */
 	twait = usec_to_timespec(6000000L);
@@ -71,13 +72,13 @@ void *inc_count(void *t)
 	
 	printf("inc_count(): thread %ld, count = %d\n",
 	       my_id, count);
-	pthread_cond_signal(&count_threshold_cv);
+	sync_cond_signal(&count_threshold_cv);
 	printf("Just sent signal.\n");
 	printf("inc_count(): thread %ld, count = %d, unlocking mutex\n", 
 	       my_id, count);
-	pthread_mutex_unlock(&count_mutex);
+	sync_mutex_unlock(&count_mutex);
 
-	pthread_cond_helpers_del(&count_threshold_cv, my_pid);
+	sync_cond_helpers_del(&count_threshold_cv, my_pid);
 	printf("Removing helper thread: thread %ld prio 93 pid %d\n", my_id, my_pid);
 	pthread_exit(NULL);
 }
@@ -114,19 +115,19 @@ void *watch_count(void *t)
 	Lock mutex and wait for signal.  Note that the pthread_cond_wait routine
 	will automatically and atomically unlock mutex while it waits. 
 	*/
-	pthread_mutex_lock(&count_mutex);
+	sync_mutex_lock(&count_mutex);
 	printf("watch_count(): thread %ld Count= %d. Going into wait...\n", my_id,count);
-	pthread_cond_wait(&count_threshold_cv, &count_mutex);
+	sync_cond_wait(&count_threshold_cv, &count_mutex);
 	/* "Consume" the item... */
 	printf("watch_count(): thread %ld Condition signal received. Count= %d\n", my_id,count);
-	printf("watch_count(): thread %ld Consuming an item...\n", my_id,count);
+	printf("watch_count(): thread %ld Consuming an item...\n", my_id);
 	twait = usec_to_timespec(2000000L);
 	busywait(&twait);
 	count -= 1;
 	printf("watch_count(): thread %ld count now = %d.\n", my_id, count);
 	
 	printf("watch_count(): thread %ld Unlocking mutex.\n", my_id);
-	pthread_mutex_unlock(&count_mutex);
+	sync_mutex_unlock(&count_mutex);
 
 	pthread_exit(NULL);
 }
@@ -168,13 +169,23 @@ void *annoyer(void *t)
 
 int main(int argc, char *argv[])
 {
-	int i, rc, ret; 
+	int i, ret;
 	long t1=1, t2=2, t3=3;
 	pthread_t threads[3];
 	pthread_attr_t attr;
 	struct sched_param param;
 	cpu_set_t mask;
+	char *sync;
 	
+	/* the non-PI mutex these runs were written for, unless told */
+	sync = getenv(SYNC_BACKEND_ENV);
+	if (sync_backend_setup(sync && *sync ? sync : "plain", 1)) {
+		printf("invalid %s, one of: %s\n", SYNC_BACKEND_ENV,
+		       sync_backend_names());
+		exit(EXIT_FAILURE);
+	}
+	printf("Main(): %s sync backend\n", sync_backend->name);
+
 	CPU_ZERO(&mask);
 	CPU_SET(1, &mask);
 	ret = sched_setaffinity(0, sizeof(mask), &mask);
@@ -193,8 +204,8 @@ int main(int argc, char *argv[])
 	}
 	
 	/* Initialize mutex and condition variable objects */
-	pthread_mutex_init(&count_mutex, NULL);
-	pthread_cond_init (&count_threshold_cv, NULL);
+	sync_mutex_init(&count_mutex, 0);
+	sync_cond_init(&count_threshold_cv);
 	
 	/* For portability, explicitly create threads in a joinable state */
 	pthread_attr_init(&attr);
@@ -214,7 +225,7 @@ int main(int argc, char *argv[])
 	
 	/* Clean up and exit */
 	pthread_attr_destroy(&attr);
-	pthread_mutex_destroy(&count_mutex);
-	pthread_cond_destroy(&count_threshold_cv);
+	sync_mutex_destroy(&count_mutex);
+	sync_cond_destroy(&count_threshold_cv);
 	pthread_exit (NULL);
 }
@@ -15,6 +15,7 @@
 #include <fcntl.h>
 #include "rt-app_utils.h"
 #include "libcv/dl_syscalls.h"
+#include "libcv/sync_backend.h"
 
 #define NUM_THREADS  3
 
@@ -22,11 +23,10 @@ int count = 0;
 int trace_fd = -1;
 int marker_fd = -1;
 int pi_cv_enabled = 0;
-pthread_mutex_t count_mutex;
-pthread_mutexattr_t count_mutex_attr;
-pthread_cond_t count_threshold_cv;
+sync_mutex_t count_mutex;
+sync_cond_t count_threshold_cv;
 
-static inline busywait(struct timespec *to)
+static inline void busywait(struct timespec *to)
 {
 	struct timespec t_step;
 	while (1) {
@@ -38,7 +38,7 @@ static inline busywait(struct timespec *to)
 
 void *inc_count(void *t) 
 {
-	int i, ret;
+	int ret;
 	long my_id = (long)t;
 	struct timespec twait;
 	struct sched_param param;
@@ -62,16 +62,16 @@ void *inc_count(void *t)
 		exit(EXIT_FAILURE);
 	}
 
-	if (pi_cv_enabled) {
+	if (sync_helpers_enabled()) {
 		ftrace_write(marker_fd, "Adding helper thread: thread %ld prio 93 pid %d\n", my_id, my_pid);
-		pthread_cond_helpers_add(&count_threshold_cv, my_pid);
+		sync_cond_helpers_add(&count_threshold_cv, my_pid);
 		ftrace_write(marker_fd, "helps on cv %p\n", &count_threshold_cv);
 	}
 
 	sleep(1);
 	ftrace_write(marker_fd, "Starting inc_count(): thread %ld prio 93\n", my_id);
 	
-	pthread_mutex_lock(&count_mutex);
+	sync_mutex_lock(&count_mutex);
 
 	/* Do some work (e.g., fill up the queue) */
 	twait = usec_to_timespec(6000000L);
@@ -79,14 +79,14 @@ void *inc_count(void *t)
 	count++;
 	
 	ftrace_write(marker_fd, "signals on cv %p\n", &count_threshold_cv);
-	pthread_cond_broadcast(&count_threshold_cv);
+	sync_cond_broadcast(&count_threshold_cv);
 	ftrace_write(marker_fd, "Just sent signal.\n");
 	ftrace_write(marker_fd, "inc_count(): thread %ld, count = %d, unlocking mutex\n", 
 	       my_id, count);
-	pthread_mutex_unlock(&count_mutex);
+	sync_mutex_unlock(&count_mutex);
 
-	if (pi_cv_enabled) {
-		pthread_cond_helpers_del(&count_threshold_cv, my_pid);
+	if (sync_helpers_enabled()) {
+		sync_cond_helpers_del(&count_threshold_cv, my_pid);
 		ftrace_write(marker_fd, "stop helping on cv %p\n", &count_threshold_cv);
 		ftrace_write(marker_fd, "Removing helper thread: thread %ld prio 93 pid %d\n", my_id, my_pid);
 	}
@@ -127,10 +127,10 @@ void *watch_count(void *t)
 	Lock mutex and wait for signal.  Note that the pthread_cond_wait routine
 	will automatically and atomically unlock mutex while it waits. 
 	*/
-	pthread_mutex_lock(&count_mutex);
+	sync_mutex_lock(&count_mutex);
 	ftrace_write(marker_fd, "watch_count(): thread %ld. Going into wait...\n", my_id,count);
 	ftrace_write(marker_fd, "waits on cv %p\n", &count_threshold_cv);
-	pthread_cond_wait(&count_threshold_cv, &count_mutex);
+	sync_cond_wait(&count_threshold_cv, &count_mutex);
 	ftrace_write(marker_fd, "wakes on cv %p\n", &count_threshold_cv);
 	/* "Consume" the item... */
 	ftrace_write(marker_fd, "watch_count(): thread %ld Condition signal received. Count= %d\n", my_id,count);
@@ -140,7 +140,7 @@ void *watch_count(void *t)
 	count -= 1;
 	
 	ftrace_write(marker_fd, "watch_count(): thread %ld Unlocking mutex.\n", my_id);
-	pthread_mutex_unlock(&count_mutex);
+	sync_mutex_unlock(&count_mutex);
 
 	pthread_exit(NULL);
 }
@@ -183,7 +183,7 @@ void *annoyer(void *t)
 
 int main(int argc, char *argv[])
 {
-	int i, rc, ret; 
+	int i, ret;
 	long t1=1, t2=2, t3=3;
 	pthread_t threads[3];
 	pthread_attr_t attr;
@@ -194,6 +194,12 @@ int main(int argc, char *argv[])
 	
 	if (argc > 1)
 		pi_cv_enabled = atoi(argv[1]);
+	if (sync_backend_setup(NULL, pi_cv_enabled)) {
+		printf("invalid %s, one of: %s\n", SYNC_BACKEND_ENV,
+		       sync_backend_names());
+		exit(EXIT_FAILURE);
+	}
+	printf("Main(): %s sync backend\n", sync_backend->name);
 
 	debugfs = "/debug";
 	strcpy(path, debugfs);
@@ -224,10 +230,8 @@ int main(int argc, char *argv[])
 	}
 	
 	/* Initialize mutex and condition variable objects */
-	pthread_mutexattr_init(&count_mutex_attr);
-	pthread_mutexattr_setprotocol(&count_mutex_attr, PTHREAD_PRIO_INHERIT);
-	pthread_mutex_init(&count_mutex, &count_mutex_attr);
-	pthread_cond_init (&count_threshold_cv, NULL);
+	sync_mutex_init(&count_mutex, 0);
+	sync_cond_init(&count_threshold_cv);
 	
 	/* For portability, explicitly create threads in a joinable state */
 	pthread_attr_init(&attr);
@@ -251,7 +255,7 @@ int main(int argc, char *argv[])
 	        write(trace_fd, "0", 1);
 	/* Clean up and exit */
 	pthread_attr_destroy(&attr);
-	pthread_mutex_destroy(&count_mutex);
-	pthread_cond_destroy(&count_threshold_cv);
+	sync_mutex_destroy(&count_mutex);
+	sync_cond_destroy(&count_threshold_cv);
 	pthread_exit (NULL);
 }
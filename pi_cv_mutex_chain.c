@@ -15,19 +15,18 @@
 #include <fcntl.h>
 #include "rt-app_utils.h"
 #include "libcv/dl_syscalls.h"
+#include "libcv/sync_backend.h"
 
 #define NUM_THREADS  4
 
 int trace_fd = -1;
 int marker_fd = -1;
 int pi_cv_enabled = 0;
-pthread_mutex_t count_mutex;
-pthread_mutexattr_t count_mutex_attr;
-pthread_cond_t count_threshold_cv;
-pthread_mutex_t rt_mutex;
-pthread_mutexattr_t rt_mutex_attr;
+sync_mutex_t count_mutex;
+sync_cond_t count_threshold_cv;
+sync_mutex_t rt_mutex;
 
-static inline busywait(struct timespec *to)
+static inline void busywait(struct timespec *to)
 {
 	struct timespec t_step;
 	while (1) {
@@ -39,7 +38,7 @@ static inline busywait(struct timespec *to)
 
 void *rt_owner(void *d) 
 {
-	int i, ret;
+	int ret;
 	struct timespec twait;
 	struct sched_param param;
 	cpu_set_t mask;
@@ -64,21 +63,21 @@ void *rt_owner(void *d)
 
 	ftrace_write(marker_fd, "Starting rt_owner(): pid %d prio 92\n", my_pid);
 	
-	pthread_mutex_lock(&rt_mutex);
+	sync_mutex_lock(&rt_mutex);
 
 	/* Do some work (e.g., fill up the queue) */
 	twait = usec_to_timespec(6000000L);
 	busywait(&twait);
 	
 	ftrace_write(marker_fd, "rt_owner(): pid %d, unlocking mutex\n", my_pid);
-	pthread_mutex_unlock(&rt_mutex);
+	sync_mutex_unlock(&rt_mutex);
 
 	pthread_exit(NULL);
 }
 
 void *helper(void *d) 
 {
-	int i, ret;
+	int ret;
 	struct timespec twait;
 	struct sched_param param;
 	cpu_set_t mask;
@@ -101,16 +100,16 @@ void *helper(void *d)
 		exit(EXIT_FAILURE);
 	}
 
-	if (pi_cv_enabled) {
+	if (sync_helpers_enabled()) {
 		ftrace_write(marker_fd, "Adding helper() thread: pid %d prio 93\n", my_pid);
-		pthread_cond_helpers_add(&count_threshold_cv, my_pid);
+		sync_cond_helpers_add(&count_threshold_cv, my_pid);
 		ftrace_write(marker_fd, "helper(): helps on cv %p\n", &count_threshold_cv);
 	}
 
 	sleep(1);
 	ftrace_write(marker_fd, "Starting helper(): pid %d prio 93\n", my_pid);
 	
-	pthread_mutex_lock(&count_mutex);
+	sync_mutex_lock(&count_mutex);
 
 	/* Do some work (e.g., fill up the queue) */
 	twait = usec_to_timespec(3000000L);
@@ -118,19 +117,19 @@ void *helper(void *d)
 	
 	/* Then block on an rt_mutex */
 	ftrace_write(marker_fd, "helper() blocks on rt_mutex %p\n", &rt_mutex);
-	pthread_mutex_lock(&rt_mutex);
+	sync_mutex_lock(&rt_mutex);
 	twait = usec_to_timespec(3000000L);
 	busywait(&twait);
-	pthread_mutex_unlock(&rt_mutex);
+	sync_mutex_unlock(&rt_mutex);
 	
 	ftrace_write(marker_fd, "helper() signals on cv %p\n", &count_threshold_cv);
-	pthread_cond_broadcast(&count_threshold_cv);
+	sync_cond_broadcast(&count_threshold_cv);
 	ftrace_write(marker_fd, "helper(): just sent signal.\n");
 	ftrace_write(marker_fd, "helper(): pid %d, unlocking mutex\n", my_pid);
-	pthread_mutex_unlock(&count_mutex);
+	sync_mutex_unlock(&count_mutex);
 
-	if (pi_cv_enabled) {
-		pthread_cond_helpers_del(&count_threshold_cv, my_pid);
+	if (sync_helpers_enabled()) {
+		sync_cond_helpers_del(&count_threshold_cv, my_pid);
 		ftrace_write(marker_fd, "helper(): stop helping on cv %p\n", &count_threshold_cv);
 		ftrace_write(marker_fd, "Removing helper() thread: pid %d prio 93\n", my_pid);
 	}
@@ -171,10 +170,10 @@ void *waiter(void *d)
 	Lock mutex and wait for signal.  Note that the pthread_cond_wait routine
 	will automatically and atomically unlock mutex while it waits. 
 	*/
-	pthread_mutex_lock(&count_mutex);
+	sync_mutex_lock(&count_mutex);
 	ftrace_write(marker_fd, "waiter(): pid %d. Going into wait...\n", my_pid);
 	ftrace_write(marker_fd, "waiter(): waits on cv %p\n", &count_threshold_cv);
-	pthread_cond_wait(&count_threshold_cv, &count_mutex);
+	sync_cond_wait(&count_threshold_cv, &count_mutex);
 	ftrace_write(marker_fd, "waiter(): wakes on cv %p\n", &count_threshold_cv);
 	/* "Consume" the item... */
 	ftrace_write(marker_fd, "waiter(): pid %d Condition signal received.\n", my_pid);
@@ -183,7 +182,7 @@ void *waiter(void *d)
 	busywait(&twait);
 	
 	ftrace_write(marker_fd, "waiter(): pid %ld Unlocking mutex.\n", my_pid);
-	pthread_mutex_unlock(&count_mutex);
+	sync_mutex_unlock(&count_mutex);
 
 	pthread_exit(NULL);
 }
@@ -226,7 +225,7 @@ void *annoyer(void *d)
 
 int main(int argc, char *argv[])
 {
-	int i, rc, ret; 
+	int i, ret;
 	pthread_t threads[NUM_THREADS];
 	pthread_attr_t attr;
 	struct sched_param param;
@@ -236,6 +235,12 @@ int main(int argc, char *argv[])
 	
 	if (argc > 1)
 		pi_cv_enabled = atoi(argv[1]);
+	if (sync_backend_setup(NULL, pi_cv_enabled)) {
+		printf("invalid %s, one of: %s\n", SYNC_BACKEND_ENV,
+		       sync_backend_names());
+		exit(EXIT_FAILURE);
+	}
+	printf("Main(): %s sync backend\n", sync_backend->name);
 
 	debugfs = "/debug";
 	strcpy(path, debugfs);
@@ -266,13 +271,9 @@ int main(int argc, char *argv[])
 	}
 	
 	/* Initialize mutex and condition variable objects */
-	pthread_mutexattr_init(&count_mutex_attr);
-	pthread_mutexattr_setprotocol(&count_mutex_attr, PTHREAD_PRIO_INHERIT);
-	pthread_mutex_init(&count_mutex, &count_mutex_attr);
-	pthread_cond_init (&count_threshold_cv, NULL);
-	pthread_mutexattr_init(&rt_mutex_attr);
-	pthread_mutexattr_setprotocol(&rt_mutex_attr, PTHREAD_PRIO_INHERIT);
-	pthread_mutex_init(&rt_mutex, &rt_mutex_attr);
+	sync_mutex_init(&count_mutex, 0);
+	sync_cond_init(&count_threshold_cv);
+	sync_mutex_init(&rt_mutex, 0);
 	
 	/* For portability, explicitly create threads in a joinable state */
 	pthread_attr_init(&attr);
@@ -298,8 +299,8 @@ int main(int argc, char *argv[])
 	        write(trace_fd, "0", 1);
 	/* Clean up and exit */
 	pthread_attr_destroy(&attr);
-	pthread_mutex_destroy(&count_mutex);
-	pthread_cond_destroy(&count_threshold_cv);
-	pthread_mutex_destroy(&rt_mutex);
+	sync_mutex_destroy(&count_mutex);
+	sync_cond_destroy(&count_threshold_cv);
+	sync_mutex_destroy(&rt_mutex);
 	pthread_exit (NULL);
 }
@@ -0,0 +1,315 @@
+/******************************************************************************
+* FILE: pi_rwlock_stress.c
+* DESCRIPTION:
+*   Priority inversion on a reader-writer lock, along the lines of
+*   pi_cv_cond_stress.c: low priority readers (prio 90) keep the lock busy,
+*   an annoyer (prio 94) periodically burns the CPU for a while and a high
+*   priority writer (prio 95) measures how long it stays blocked on the
+*   lock. Without boosting a reader preempted by the annoyer holds the
+*   writer up for the rest of the burst; with it (uboost, or pi-cond on a
+*   kernel with helper support) the readers holding the lock run at the
+*   writer's priority until they leave.
+*
+*   Readers yield halfway through their read section, as if their time
+*   slice ended there, so that with N readers up to N of them hold the
+*   lock at once. The readers together keep the CPU busy for about a
+*   quarter of the time, and so does the annoyer, well clear of RT
+*   throttling. Everything runs on a single CPU, and the run is repeated
+*   for every reader count.
+*
+*   Run it with -B pi for the baseline and -B uboost for the boosted case.
+******************************************************************************/
+#define _GNU_SOURCE
+#include <sched.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "rt-app_utils.h"
+#include "stats.h"
+#include "libcv/dl_syscalls.h"
+#include "libcv/sync_backend.h"
+#include "libcv/boost.h"
+#include "libcv/pi_rwlock.h"
+
+#define MAX_COUNTS	16
+#define MAX_READERS	64
+#define READER_PRIO	90
+#define ANNOYER_PRIO	94
+#define WRITER_PRIO	95
+#define MAIN_PRIO	96
+
+struct global_args_t {
+	int counts[MAX_COUNTS];	/* -r reader counts to run */
+	int ncounts;
+	int iterations;		/* -i write locks per reader count */
+	long hold;		/* -h read section (usec) */
+	long period;		/* -w writer period (usec) */
+	long burst;		/* -a annoyer burst (usec), every 4 bursts */
+	int cpu;		/* -C CPU everything runs on */
+	char *sync;		/* -B sync backend */
+} global_args;
+
+static const char *opt_string = "r:i:h:w:a:C:B:";
+
+pi_rwlock_t rwlock;
+int stop;
+hist_t block;
+unsigned long contended;
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return timespec_to_nsec(&now);
+}
+
+/* Burn usec of this thread's CPU time */
+static void busywait(long usec)
+{
+	struct timespec t_step, to, t = usec_to_timespec(usec);
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t_step);
+	to = timespec_add(&t_step, &t);
+	while (1) {
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t_step);
+		if (!timespec_lower(&t_step, &to))
+			break;
+	}
+}
+
+/* Sleep until *next, then move it one period on */
+static void next_period(struct timespec *next, long usec)
+{
+	struct timespec t = usec_to_timespec(usec);
+
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL);
+	*next = timespec_add(next, &t);
+}
+
+static void pin_thread(int prio)
+{
+	struct sched_param param;
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(global_args.cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+		printf("pthread_setaffinity failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	param.sched_priority = prio;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+		printf("pthread_setschedparam failed\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void *reader(void *t)
+{
+	long nreaders = (long) t, gap = (4 * nreaders - 1) * global_args.hold;
+	unsigned int seed = gettid();
+	struct timespec ts;
+
+	pin_thread(READER_PRIO);
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		pi_rwlock_rdlock(&rwlock);
+		busywait(global_args.hold / 2);
+		sched_yield();
+		busywait(global_args.hold / 2);
+		pi_rwlock_unlock(&rwlock);
+		/* random, or the readers lock on to the annoyer's phase */
+		ts = usec_to_timespec(rand_r(&seed) % (2 * gap));
+		nanosleep(&ts, NULL);
+	}
+
+	pthread_exit(NULL);
+}
+
+void *annoyer(void *t)
+{
+	struct timespec next;
+
+	pin_thread(ANNOYER_PRIO);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		next_period(&next, 4 * global_args.burst);
+		busywait(global_args.burst);
+	}
+
+	pthread_exit(NULL);
+}
+
+void *writer(void *t)
+{
+	unsigned long long t_call;
+	struct timespec next;
+	int i;
+
+	pin_thread(WRITER_PRIO);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; i < global_args.iterations; i++) {
+		next_period(&next, global_args.period);
+		t_call = now_nsec();
+		if (pi_rwlock_trywrlock(&rwlock) != 0) {
+			contended++;
+			pi_rwlock_wrlock(&rwlock);
+		}
+		hist_add(&block, now_nsec() - t_call);
+		/* update the table */
+		busywait(10);
+		pi_rwlock_unlock(&rwlock);
+	}
+
+	pthread_exit(NULL);
+}
+
+static void run_readers(int nreaders)
+{
+	pthread_t readers[MAX_READERS], a, w;
+	boost_stats_t bst;
+	int i;
+
+	hist_init(&block);
+	contended = 0;
+	stop = 0;
+	pi_rwlock_init(&rwlock);
+	if (sync_backend->boost)
+		boost_reset_stats();
+
+	for (i = 0; i < nreaders; i++)
+		pthread_create(&readers[i], NULL, reader,
+			       (void *)(long)nreaders);
+	pthread_create(&a, NULL, annoyer, NULL);
+	pthread_create(&w, NULL, writer, NULL);
+
+	pthread_join(w, NULL);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	pthread_join(a, NULL);
+	for (i = 0; i < nreaders; i++)
+		pthread_join(readers[i], NULL);
+	pi_rwlock_destroy(&rwlock);
+
+	printf("%d readers, %d write locks, %lu contended\n", nreaders,
+	       global_args.iterations, contended);
+	hist_print(stdout, "  writer blocked", &block);
+	if (sync_backend->boost) {
+		boost_get_stats(&bst);
+		boost_stats_print(stdout, &bst);
+	}
+	fflush(stdout);
+}
+
+static int parse_counts(const char *arg)
+{
+	const char *p = arg;
+	char *end;
+	long n;
+
+	global_args.ncounts = 0;
+	while (*p) {
+		n = strtol(p, &end, 10);
+		if (end == p || n < 1 || n > MAX_READERS ||
+		    global_args.ncounts == MAX_COUNTS)
+			return 1;
+		global_args.counts[global_args.ncounts++] = n;
+		p = end;
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return 1;
+	}
+
+	return !global_args.ncounts;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sched_param param;
+	cpu_set_t mask;
+	int i, opt;
+
+	parse_counts("1,2,4,8,16");
+	global_args.iterations = 200;
+	global_args.hold = 1000;
+	global_args.period = 7000;
+	global_args.burst = 5000;
+	global_args.cpu = -1;
+
+	while ((opt = getopt(argc, argv, opt_string)) != -1) {
+		switch (opt) {
+		case 'r':
+			if (parse_counts(optarg)) {
+				printf("invalid reader counts %s (1..%d)\n",
+				       optarg, MAX_READERS);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 'i':
+			global_args.iterations = atoi(optarg);
+			break;
+		case 'h':
+			global_args.hold = atol(optarg);
+			break;
+		case 'w':
+			global_args.period = atol(optarg);
+			break;
+		case 'a':
+			global_args.burst = atol(optarg);
+			break;
+		case 'C':
+			global_args.cpu = atoi(optarg);
+			break;
+		case 'B':
+			global_args.sync = optarg;
+			break;
+		}
+	}
+
+	if (global_args.iterations < 1 || global_args.hold < 2 ||
+	    global_args.period < 1 || global_args.burst < 1) {
+		printf("invalid iterations, hold, period or burst\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (sync_backend_setup(global_args.sync, 1)) {
+		printf("invalid sync backend %s, one of: %s\n",
+		       global_args.sync, sync_backend_names());
+		exit(EXIT_INV_COMMANDLINE);
+	}
+
+	/* first CPU we are allowed on, unless told otherwise */
+	if (global_args.cpu < 0) {
+		sched_getaffinity(0, sizeof(mask), &mask);
+		for (i = 0; i < CPU_SETSIZE && !CPU_ISSET(i, &mask); i++)
+			;
+		global_args.cpu = i;
+	}
+
+	/* out of the way, only wakes up to collect the threads */
+	param.sched_priority = MAIN_PRIO;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+		printf("pthread_setschedparam failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("Main(): %s sync backend, cpu %d, %s readers\n",
+	       sync_backend->name, global_args.cpu,
+	       sync_backend->boost ? "boosted" :
+	       sync_helpers_enabled() ? "kernel helper" : "unboosted");
+	printf("Main(): read section %ldus, writer every %ldus, "
+	       "annoyer %ldus every %ldus\n", global_args.hold,
+	       global_args.period, global_args.burst, 4 * global_args.burst);
+
+	for (i = 0; i < global_args.ncounts; i++)
+		run_readers(global_args.counts[i]);
+
+	return 0;
+}
@@ -0,0 +1,478 @@
+/******************************************************************************
+* FILE: placement.c
+* DESCRIPTION:
+*  CPU topology discovery and placement policies, see placement.h.
+******************************************************************************/
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include "placement.h"
+#include "rt-app_utils.h"
+
+#define SYSFS_CPU	"/sys/devices/system/cpu"
+
+static const char *role_names[ROLE_NR] = { "main", "prod", "cons", "annoy",
+					       "relay" };
+
+static const char *policy_names[] = { "none", "one", "spread", "smt", "llc",
+				      "cross-socket", "map" };
+
+static int read_sysfs_str(const char *path, char *buf, int len)
+{
+	FILE *f;
+	char *nl;
+
+	f = fopen(path, "r");
+	if (!f)
+		return 1;
+	if (!fgets(buf, len, f)) {
+		fclose(f);
+		return 1;
+	}
+	fclose(f);
+
+	nl = strchr(buf, '\n');
+	if (nl)
+		*nl = '\0';
+
+	return 0;
+}
+
+static int read_sysfs_int(const char *path, int def)
+{
+	char buf[32];
+
+	if (read_sysfs_str(path, buf, sizeof(buf)))
+		return def;
+
+	return atoi(buf);
+}
+
+/*
+ * Parse a cpulist ("0-3,8,10-11") into cpus[], returns the number of
+ * entries or -1 on a malformed list.
+ */
+static int parse_cpulist(const char *s, int *cpus, int max)
+{
+	int n = 0, first, last;
+	char *end;
+
+	while (*s) {
+		first = strtol(s, &end, 10);
+		if (end == s || first < 0)
+			return -1;
+		last = first;
+		s = end;
+		if (*s == '-') {
+			s++;
+			last = strtol(s, &end, 10);
+			if (end == s || last < first)
+				return -1;
+			s = end;
+		}
+		for (; first <= last && n < max; first++)
+			cpus[n++] = first;
+		if (*s == ',')
+			s++;
+		else if (*s)
+			return -1;
+	}
+
+	return n;
+}
+
+static int read_cpulist(const char *path, int *cpus, int max)
+{
+	char buf[1024];
+
+	if (read_sysfs_str(path, buf, sizeof(buf)))
+		return 0;
+
+	return parse_cpulist(buf, cpus, max);
+}
+
+static int cpu_node(int cpu)
+{
+	char path[128];
+	struct dirent *de;
+	DIR *dir;
+	int node = 0;
+
+	snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d", cpu);
+	dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	while ((de = readdir(dir))) {
+		if (strncmp(de->d_name, "node", 4) == 0 &&
+		    de->d_name[4] >= '0' && de->d_name[4] <= '9') {
+			node = atoi(de->d_name + 4);
+			break;
+		}
+	}
+	closedir(dir);
+
+	return node;
+}
+
+/* First CPU sharing the highest level cache with cpu */
+static int cpu_llc(int cpu)
+{
+	char path[128];
+	int cpus[CPU_SETSIZE];
+	int idx, level, best = -1, llc = cpu;
+
+	for (idx = 0; ; idx++) {
+		snprintf(path, sizeof(path),
+			 SYSFS_CPU "/cpu%d/cache/index%d/level", cpu, idx);
+		level = read_sysfs_int(path, -1);
+		if (level < 0)
+			break;
+		if (level <= best)
+			continue;
+		snprintf(path, sizeof(path),
+			 SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list",
+			 cpu, idx);
+		if (read_cpulist(path, cpus, CPU_SETSIZE) > 0) {
+			best = level;
+			llc = cpus[0];
+		}
+	}
+
+	return llc;
+}
+
+int topology_read(topology_t *t)
+{
+	int cpus[CPU_SETSIZE];
+	char path[128];
+	cpu_topo_t *c;
+	int i, j, n;
+
+	memset(t, 0, sizeof(*t));
+
+	n = read_cpulist(SYSFS_CPU "/online", cpus, CPU_SETSIZE);
+	if (n <= 0) {
+		log_error("cannot read online CPUs from sysfs");
+		return 1;
+	}
+
+	for (i = 0; i < n; i++) {
+		c = &t->cpu[cpus[i]];
+		c->online = 1;
+		if (cpus[i] >= t->nr_cpus)
+			t->nr_cpus = cpus[i] + 1;
+	}
+
+	for (i = 0; i < t->nr_cpus; i++) {
+		int sib[CPU_SETSIZE];
+
+		c = &t->cpu[i];
+		if (!c->online)
+			continue;
+
+		snprintf(path, sizeof(path),
+			 SYSFS_CPU "/cpu%d/topology/core_cpus_list", i);
+		n = read_cpulist(path, sib, CPU_SETSIZE);
+		if (n <= 0) {
+			snprintf(path, sizeof(path), SYSFS_CPU
+				 "/cpu%d/topology/thread_siblings_list", i);
+			n = read_cpulist(path, sib, CPU_SETSIZE);
+		}
+		c->core = n > 0 ? sib[0] : i;
+		c->smt = 0;
+		for (j = 0; j < n; j++)
+			if (sib[j] == i)
+				c->smt = j;
+
+		snprintf(path, sizeof(path),
+			 SYSFS_CPU "/cpu%d/topology/physical_package_id", i);
+		c->socket = read_sysfs_int(path, 0);
+		if (c->socket < 0)
+			c->socket = 0;
+
+		c->llc = cpu_llc(i);
+		c->node = cpu_node(i);
+	}
+
+	n = read_cpulist(SYSFS_CPU "/isolated", cpus, CPU_SETSIZE);
+	for (i = 0; i < n; i++)
+		if (cpus[i] < t->nr_cpus)
+			t->cpu[cpus[i]].isolated = 1;
+
+	n = read_cpulist(SYSFS_CPU "/nohz_full", cpus, CPU_SETSIZE);
+	for (i = 0; i < n; i++)
+		if (cpus[i] < t->nr_cpus)
+			t->cpu[cpus[i]].nohz_full = 1;
+
+	return 0;
+}
+
+int placement_parse(const char *spec, placement_t *p)
+{
+	char buf[PLACEMENT_MAP_LENGTH * ROLE_NR];
+	char *tok, *save, *eq;
+	int i, r;
+
+	memset(p, 0, sizeof(*p));
+
+	if (strncmp(spec, "map:", 4) != 0) {
+		for (i = 0; i < PLACE_MAP; i++) {
+			if (strcmp(spec, policy_names[i]) == 0) {
+				p->policy = i;
+				return 0;
+			}
+		}
+		return 1;
+	}
+
+	p->policy = PLACE_MAP;
+	strncpy(buf, spec + 4, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+
+	for (tok = strtok_r(buf, ":", &save); tok;
+	     tok = strtok_r(NULL, ":", &save)) {
+		eq = strchr(tok, '=');
+		if (!eq)
+			return 1;
+		*eq = '\0';
+		for (r = 0; r < ROLE_NR; r++)
+			if (strcmp(tok, role_names[r]) == 0)
+				break;
+		if (r == ROLE_NR || strlen(eq + 1) >= PLACEMENT_MAP_LENGTH)
+			return 1;
+		strcpy(p->map[r], eq + 1);
+	}
+
+	return 0;
+}
+
+static void assign(placement_t *p, role_t r, const int *list, int n, int *next)
+{
+	int i;
+
+	for (i = 0; i < p->nthreads[r]; i++)
+		p->cpus[r][i] = list[(*next)++ % n];
+}
+
+static int cpu_used(const placement_t *p, int cpu)
+{
+	int r, i;
+
+	for (r = ROLE_PROD; r < ROLE_NR; r++)
+		for (i = 0; i < p->nthreads[r]; i++)
+			if (p->cpus[r][i] == cpu)
+				return 1;
+
+	return 0;
+}
+
+/*
+ * Online CPUs workers may use, one SMT sibling per core first. Isolated
+ * CPUs are preferred when there are any; *house gets a housekeeping CPU.
+ */
+static int candidates(const topology_t *t, int *cand, int *house)
+{
+	int i, smt, n = 0, isolated = 0, max_smt = 0;
+
+	*house = -1;
+	for (i = 0; i < t->nr_cpus; i++) {
+		if (!t->cpu[i].online)
+			continue;
+		if (t->cpu[i].isolated)
+			isolated = 1;
+		else if (*house < 0)
+			*house = i;
+		if (t->cpu[i].smt > max_smt)
+			max_smt = t->cpu[i].smt;
+	}
+
+	for (smt = 0; smt <= max_smt; smt++)
+		for (i = 0; i < t->nr_cpus; i++)
+			if (t->cpu[i].online && t->cpu[i].smt == smt &&
+			    (!isolated || t->cpu[i].isolated))
+				cand[n++] = i;
+
+	return n;
+}
+
+static int resolve_map(placement_t *p, const topology_t *t)
+{
+	int list[CPU_SETSIZE];
+	int r, i, n, next;
+
+	for (r = 0; r < ROLE_NR; r++) {
+		if (!p->map[r][0])
+			continue;
+		n = parse_cpulist(p->map[r], list, CPU_SETSIZE);
+		if (n <= 0) {
+			log_error("invalid cpulist %s for %s", p->map[r],
+				  role_names[r]);
+			return 1;
+		}
+		for (i = 0; i < n; i++) {
+			if (list[i] >= t->nr_cpus || !t->cpu[list[i]].online) {
+				log_error("CPU%d is not online", list[i]);
+				return 1;
+			}
+		}
+		next = 0;
+		assign(p, r, list, n, &next);
+	}
+
+	return 0;
+}
+
+int placement_resolve(placement_t *p, const topology_t *t)
+{
+	int cand[CPU_SETSIZE], other[CPU_SETSIZE];
+	int r, i, n, m, house, next = 0;
+
+	p->nthreads[ROLE_MAIN] = 1;
+	for (r = 0; r < ROLE_NR; r++) {
+		p->cpus[r] = malloc((p->nthreads[r] + 1) * sizeof(int));
+		if (!p->cpus[r])
+			return 1;
+		for (i = 0; i < p->nthreads[r]; i++)
+			p->cpus[r][i] = -1;
+	}
+
+	if (p->policy == PLACE_NONE)
+		return 0;
+	if (p->policy == PLACE_MAP)
+		return resolve_map(p, t);
+
+	n = candidates(t, cand, &house);
+
+	switch (p->policy) {
+	case PLACE_ONE:
+		for (r = ROLE_PROD; r < ROLE_NR; r++)
+			assign(p, r, cand, 1, &next);
+		break;
+	case PLACE_SPREAD:
+		assign(p, ROLE_CONS, cand, n, &next);
+		assign(p, ROLE_RELAY, cand, n, &next);
+		assign(p, ROLE_PROD, cand, n, &next);
+		break;
+	case PLACE_SMT:
+		for (i = 0; i < n; i++) {
+			for (m = i + 1; m < n; m++)
+				if (t->cpu[cand[m]].core == t->cpu[cand[i]].core)
+					break;
+			if (m < n)
+				break;
+		}
+		if (i == n) {
+			log_error("no usable SMT siblings on this machine");
+			return 1;
+		}
+		assign(p, ROLE_PROD, &cand[i], 1, &next);
+		next = 0;
+		assign(p, ROLE_CONS, &cand[m], 1, &next);
+		next = 0;
+		assign(p, ROLE_RELAY, &cand[m], 1, &next);
+		break;
+	case PLACE_LLC:
+		for (i = 0, m = 0; i < n; i++)
+			if (t->cpu[cand[i]].llc == t->cpu[cand[0]].llc)
+				other[m++] = cand[i];
+		assign(p, ROLE_CONS, other, m, &next);
+		assign(p, ROLE_RELAY, other, m, &next);
+		assign(p, ROLE_PROD, other, m, &next);
+		break;
+	case PLACE_CROSS_SOCKET:
+		for (i = 0, m = 0; i < n; i++)
+			if (t->cpu[cand[i]].socket != t->cpu[cand[0]].socket)
+				other[m++] = cand[i];
+		if (m == 0) {
+			log_error("cross-socket placement needs two sockets");
+			return 1;
+		}
+		for (i = 0, r = 0; i < n; i++)
+			if (t->cpu[cand[i]].socket == t->cpu[cand[0]].socket)
+				cand[r++] = cand[i];
+		assign(p, ROLE_PROD, cand, r, &next);
+		next = 0;
+		assign(p, ROLE_CONS, other, m, &next);
+		assign(p, ROLE_RELAY, other, m, &next);
+		break;
+	default:
+		break;
+	}
+
+	/* annoyers preempt the helpers, they share producers' runqueues */
+	for (i = 0; i < p->nthreads[ROLE_ANNOY] && p->nthreads[ROLE_PROD]; i++)
+		p->cpus[ROLE_ANNOY][i] =
+			p->cpus[ROLE_PROD][i % p->nthreads[ROLE_PROD]];
+
+	if (house >= 0 && !cpu_used(p, house)) {
+		p->cpus[ROLE_MAIN][0] = house;
+	} else {
+		for (i = 0; i < t->nr_cpus; i++) {
+			if (t->cpu[i].online && !cpu_used(p, i)) {
+				p->cpus[ROLE_MAIN][0] = i;
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void placement_free(placement_t *p)
+{
+	int r;
+
+	for (r = 0; r < ROLE_NR; r++) {
+		free(p->cpus[r]);
+		p->cpus[r] = NULL;
+	}
+}
+
+int placement_cpu(const placement_t *p, role_t role, int idx)
+{
+	if (!p->cpus[role] || idx >= p->nthreads[role])
+		return -1;
+
+	return p->cpus[role][idx];
+}
+
+int placement_pin(int cpu)
+{
+	cpu_set_t mask;
+
+	if (cpu < 0)
+		return 0;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+
+	return sched_setaffinity(0, sizeof(mask), &mask);
+}
+
+void placement_print(FILE *out, const placement_t *p, const topology_t *t)
+{
+	const cpu_topo_t *c;
+	int r, i, cpu;
+
+	fprintf(out, "placement: %s\n", policy_names[p->policy]);
+
+	for (r = 0; r < ROLE_NR; r++) {
+		for (i = 0; i < p->nthreads[r]; i++) {
+			cpu = placement_cpu(p, r, i);
+			if (cpu < 0) {
+				fprintf(out, "  %-5s %2d -> any\n",
+					role_names[r], i);
+				continue;
+			}
+			c = &t->cpu[cpu];
+			fprintf(out, "  %-5s %2d -> cpu %d (core %d smt %d"
+				" llc %d node %d socket %d%s%s)\n",
+				role_names[r], i, cpu, c->core, c->smt,
+				c->llc, c->node, c->socket,
+				c->isolated ? " isolated" : "",
+				c->nohz_full ? " nohz_full" : "");
+		}
+	}
+}
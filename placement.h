@@ -0,0 +1,102 @@
+/******************************************************************************
+* FILE: placement.h
+* DESCRIPTION:
+*  CPU topology discovery (sysfs) and thread placement policies.
+*
+*  The topology records, for every online CPU, its physical core (first
+*  SMT sibling), last level cache domain, NUMA node, socket and whether it
+*  is isolated (isolcpus) or nohz_full. When isolated CPUs exist the
+*  automatic policies place workers on them and keep main on a housekeeping
+*  CPU.
+*
+*  Policies:
+*   none		no pinning
+*   one			every worker on the same CPU, main elsewhere
+*   spread		one physical core per worker, SMT siblings used last
+*   smt			producers and consumers on SMT siblings of one core
+*   llc			workers on distinct cores sharing one LLC
+*   cross-socket	producers and consumers on different sockets
+*   map:ROLE=LIST[:ROLE=LIST...]
+*			explicit cpulist per role (main, prod, cons, annoy,
+*			relay),
+*			threads of a role are spread round-robin on its list,
+*			roles left out inherit main's affinity
+*
+*  Annoyers stand in for other RT work on the helpers' runqueues, so the
+*  automatic policies put them on the producers' CPUs. Relays (middle
+*  stages of a pipeline) are placed like consumers.
+******************************************************************************/
+#ifndef _PLACEMENT_H_
+#define _PLACEMENT_H_
+
+#include <sched.h>
+#include <stdio.h>
+
+#define PLACEMENT_MAP_LENGTH	128
+
+typedef enum role_t
+{
+	ROLE_MAIN = 0,
+	ROLE_PROD,
+	ROLE_CONS,
+	ROLE_ANNOY,
+	ROLE_RELAY,
+	ROLE_NR
+} role_t;
+
+typedef enum placement_policy_t
+{
+	PLACE_NONE = 0,
+	PLACE_ONE,
+	PLACE_SPREAD,
+	PLACE_SMT,
+	PLACE_LLC,
+	PLACE_CROSS_SOCKET,
+	PLACE_MAP
+} placement_policy_t;
+
+typedef struct _cpu_topo_t {
+	int online;
+	int core;
+	int smt;
+	int llc;
+	int node;
+	int socket;
+	int isolated;
+	int nohz_full;
+} cpu_topo_t;
+
+typedef struct _topology_t {
+	int nr_cpus;
+	cpu_topo_t cpu[CPU_SETSIZE];
+} topology_t;
+
+typedef struct _placement_t {
+	placement_policy_t policy;
+	char map[ROLE_NR][PLACEMENT_MAP_LENGTH];
+	int nthreads[ROLE_NR];
+	int *cpus[ROLE_NR];
+} placement_t;
+
+int topology_read(topology_t *t);
+
+int placement_parse(const char *spec, placement_t *p);
+
+/*
+ * Compute the CPU of every thread, given the number of threads of each
+ * role in p->nthreads. Returns non-zero if the policy cannot be honored on
+ * this machine.
+ */
+int placement_resolve(placement_t *p, const topology_t *t);
+
+void placement_free(placement_t *p);
+
+/* CPU assigned to thread idx of role, -1 if it is not pinned */
+int placement_cpu(const placement_t *p, role_t role, int idx);
+
+/* Pin the calling thread on cpu, no-op if cpu < 0 */
+int placement_pin(int cpu);
+
+void placement_print(FILE *out, const placement_t *p, const topology_t *t);
+
+#endif /* _PLACEMENT_H_ */
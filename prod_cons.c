@@ -23,20 +23,53 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/stat.h> 
 #include <sys/syscall.h> 
 #include <fcntl.h>
 #include <assert.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <signal.h>
 #include "rt-app_utils.h"
+#include "rand_dist.h"
+#include "stats.h"
+#include "trace_replay.h"
+#include "placement.h"
+#include "memlock.h"
+#include "syscount.h"
+#include "payload.h"
+#include "notify.h"
 #include "libcv/dl_syscalls.h"
+#include "libcv/sync_backend.h"
+#include "libcv/boost.h"
+#include "libcv/pi_sem.h"
 
 #define	BSIZE		8
 #define MAX_PROD	10
 #define MAX_CONS	10
 #define MAX_ANNOY	10
+#define MAX_RELAY	30
+#define MAX_THREADS	(MAX_PROD + MAX_CONS + MAX_ANNOY + MAX_RELAY)
+#define MAX_STAGES	5
+#define NR_CLASSES	4
+
+/* Phases of a job, with respect to the buffer lock */
+enum {
+	WORK_PRE = 0,
+	WORK_IN,
+	WORK_POST,
+	WORK_NR
+};
+
+typedef enum queue_t
+{
+	QUEUE_FIFO = 0,
+	QUEUE_EDF,
+	QUEUE_PRIO
+} queue_t;
 
 struct global_args_t {
 	int num_prod;		/* -p # of producers */
@@ -45,37 +78,181 @@ struct global_args_t {
 	int pi_cv_enabled;	/* -P PI-cond enabled */
 	int ftrace;		/* -f ftrace enabled */
 	int duration;		/* -d duration (sec) */
-	int affinity;		/* -A all threads run on CPU0 */
+	placement_t placement;	/* -L thread placement, -A same as -L one */
+	dist_t service;		/* -S service time distribution (usec) */
+	unsigned long seed;	/* -s PRNG seed */
+	char *replay_file;	/* -r replay a recorded trace */
+	int lock_pages;		/* -m lock memory, stack KB[,huge] */
+	size_t stack_size;
+	int huge_stack;
+	int throughput;		/* -T throughput mode, in-lock work (nsec) */
+	long tput_work;
+	queue_t queue;		/* -Q fifo, edf:DIST (usec) or prio:N */
+	dist_t deadline;
+	int nprio;
+	int payload;		/* -M payloads, [copy:]DIST (bytes) */
+	int payload_copy;
+	dist_t payload_size;
+	int work_split[WORK_NR];	/* -W pre:in:post work ratios */
+	int work_total;
+	int elide;		/* -E signal only unwoken waiters */
+	int nstages;		/* -X pipeline, THREADS@PRIO per stage */
+	int stage_threads[MAX_STAGES];
+	int stage_prio[MAX_STAGES];
+	int num_relay;
+	notify_kind_t notify;	/* -N cond, pi-cond, futex or eventfd */
+	char *sync;		/* -B mutex/condvar backend */
+	unsigned long budget;	/* -b helper boost budget, RUNTIME/PERIOD */
+	unsigned long budget_period;	/* (usec), uboost backends */
+	int pi_queue;		/* -q buffers are libcv PI queues */
+	int processes;		/* -F one process per thread, shared buffers */
+	int timed;		/* -t consumers give up waiting after DIST */
+	dist_t timeout;		/* (usec) and wait again */
+	int spin;		/* -w consumers poll an empty buffer first */
 } global_args;
 
-static const char *opt_string = "p:c:a:Pfd:A";
+static const char *opt_string = "p:c:a:Pfd:AS:s:r:L:m:T:Q:M:W:EX:N:B:b:qFt:w";
+
+/* System calls counted while measuring, futex first */
+enum {
+	SYS_FUTEX = 0,
+	SYS_READ,
+	SYS_WRITE,
+	SYS_EPOLL_WAIT,
+	SYS_NR
+};
+
+static const char *syscall_names[SYS_NR] = { "futex", "read", "write",
+					     "epoll_wait" };
+
+/*
+ * With -Q edf and -Q prio buf[] is a binary min-heap on key instead of a
+ * ring: the most urgent item is always in buf[0].
+ *
+ * With -M an item describes a payload of len bytes: slot is in the slab of
+ * its producer, or in the buffer data area with -M copy.
+ */
+typedef struct {
+	int id;
+	int prod;			/* producer index */
+	int slot;
+	unsigned int len;
+	unsigned long long born;	/* enqueued in the first stage (nsec) */
+	int prio;			/* priority, or relative deadline decade */
+	unsigned long long enqueued;	/* nsec (CLOCK_MONOTONIC) */
+	unsigned long long key;		/* heap key, smaller is more urgent */
+	unsigned long long deadline;	/* absolute, nsec (CLOCK_MONOTONIC) */
+} item_t;
+
+/*
+ * Threads blocked on a condvar, and how many of them have already been
+ * signaled but did not run yet. Only touched with the buffer mutex held.
+ */
+typedef struct {
+	int waiting;
+	int woken;
+} waiters_t;
 
 typedef struct {
-	int buf[BSIZE];
+	item_t buf[BSIZE];
 	int occupied;
 	int nextin;
 	int nextout;
-	pthread_mutex_t mutex;
-	pthread_mutexattr_t mutex_attr;
-	pthread_cond_t more;
-	pthread_cond_t less;
+	unsigned long long seq;
+	char *data;		/* BSIZE payloads, -M copy only */
+	int data_free[BSIZE];
+	int nfree;
+	sync_mutex_t mutex;
+	notify_t more;
+	notify_t less;
+	pi_queue_t queue;	/* -q, instead of all of the above */
+	waiters_t more_waiters;
+	waiters_t less_waiters;
+	sync_spin_t spin;	/* -w, producers on their way to put */
 } buffer_t;
 
-buffer_t buffer;
-pid_t pids[MAX_PROD + MAX_CONS + MAX_ANNOY];
+typedef struct {
+	unsigned long items;
+	unsigned long locks;	/* mutex acquisitions, cond_wait returns too */
+	unsigned long waits;	/* condition waits */
+	unsigned long long bytes;	/* payload bytes consumed */
+	unsigned long signals;	/* condition signals */
+	unsigned long idle;	/* signals nobody needed, elided with -E */
+	unsigned long timeouts;	/* condition waits that gave up, -t */
+} counters_t;
+
+typedef struct {
+	counters_t cnt;
+	hist_t wait;		/* lock request to free slot/item (nsec) */
+	hist_t wake;		/* signal to mutex retaken by the waiter */
+	hist_t release;		/* replay release to item enqueued (nsec) */
+	hist_t hold;		/* slot/item found to unlock (nsec), -M */
+	hist_t lock;		/* buffer mutex acquisition (nsec) */
+	hist_t block;		/* blocked in a condition wait (nsec) */
+	hist_t overshoot;	/* timeout to running again, -t (nsec) */
+	hist_t queue;		/* enqueue to dequeue of the input stage */
+	hist_t e2e;		/* first enqueue to processed, consumers */
+	unsigned long done[NR_CLASSES];
+	unsigned long late[NR_CLASSES];
+	hist_t tardy[NR_CLASSES];	/* max(0, completion - deadline) */
+	hist_t response;	/* annoyer release to burst done (nsec) */
+} thread_stats_t;
+
+/* Per consumer queueing delay breakdown */
+typedef struct {
+	hist_t dequeue[MAX_PROD];	/* enqueue to dequeue, per producer */
+	hist_t done[MAX_PROD];		/* enqueue to processed, per producer */
+	hist_t dequeue_prio[NR_CLASSES];
+	hist_t done_prio[NR_CLASSES];
+} sojourn_t;
+
+/*
+ * Stage k of a pipeline puts items into buffers[k], and stage k + 1 takes
+ * them out; without -X there is only buffers[0].
+ *
+ * Everything the workers write and somebody else reads. With -F this is a
+ * shared memory segment mapped before the workers are forked, and the
+ * buffer mutexes and condvars in it are PTHREAD_PROCESS_SHARED.
+ */
+typedef struct {
+	buffer_t buffers[MAX_STAGES - 1];
+	pid_t pids[MAX_THREADS];
+	thread_stats_t stats[MAX_THREADS];
+	sojourn_t sojourn[MAX_CONS];
+	volatile int shutdown;
+} shared_t;
+
+shared_t local, *shm = &local;
+buffer_t *buffers = local.buffers;
+pid_t *pids = local.pids;
+thread_stats_t *stats = local.stats;
+sojourn_t *sojourn = local.sojourn;
+int stage_first[MAX_STAGES];	/* id of the first thread of each stage */
+counters_t warm[MAX_THREADS];
+slab_t slabs[MAX_PROD];
+char *scratch[MAX_PROD + MAX_CONS];	/* private payload copies, -M copy */
+trace_t replay;
+topology_t topology;
+void *stacks[MAX_THREADS];
+size_t stack_sizes[MAX_THREADS];
+struct timespec replay_start;
 int trace_fd = -1;
 int marker_fd = -1;
 int pi_cv_enabled = 0;
-volatile int shutdown = 0;
 
-static inline long rand_wait(void)
+/*
+ * Service time (usec) of a job; each thread draws from its own generator,
+ * so no lock is taken inside the critical section.
+ */
+static inline long rand_wait(struct rand_state *rs)
 {
-	int min = 10, max = 101;
-	long result;
-
-	result = (rand() % (max - min)) + min;
+	return dist_sample(&global_args.service, rs);
+}
 
-	return result;
+static inline unsigned long long elapsed_nsec(struct timespec *from,
+						 struct timespec *to)
+{
+	return timespec_to_nsec(to) - timespec_to_nsec(from);
 }
 
 static inline void busywait(struct timespec *to)
@@ -88,31 +265,355 @@ static inline void busywait(struct timespec *to)
 	}
 }
 
+/*
+ * Throughput mode work: CLOCK_THREAD_CPUTIME_ID is a real syscall, so tiny
+ * amounts of work are timed with the (vDSO) monotonic clock instead.
+ */
+static inline void spin_nsec(long nsec)
+{
+	struct timespec t_step, t_end, t_work;
+
+	if (nsec <= 0)
+		return;
+
+	t_work.tv_sec = nsec / 1000000000L;
+	t_work.tv_nsec = nsec % 1000000000L;
+	clock_gettime(CLOCK_MONOTONIC, &t_step);
+	t_end = timespec_add(&t_step, &t_work);
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &t_step);
+	} while (timespec_lower(&t_step, &t_end));
+}
+
+/*
+ * Run the share of a job of nsec that belongs to phase: CPU time in the
+ * default mode, wall clock time in throughput mode (see spin_nsec()).
+ */
+static inline void job_work(long nsec, int phase)
+{
+	struct timespec t_work, now;
+
+	nsec = nsec * global_args.work_split[phase] / global_args.work_total;
+	if (nsec <= 0)
+		return;
+
+	if (global_args.throughput) {
+		spin_nsec(nsec);
+		return;
+	}
+
+	t_work.tv_sec = nsec / 1000000000L;
+	t_work.tv_nsec = nsec % 1000000000L;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	t_work = timespec_add(&now, &t_work);
+	busywait(&t_work);
+}
+
+/*
+ * Urgency class and deadline of a new item, created at time *now. EDF
+ * classes are the decades of the relative deadline: < 1ms, < 10ms, < 100ms
+ * and the rest.
+ */
+static inline void item_init(item_t *it, int id, struct timespec *now,
+			     struct rand_state *rs)
+{
+	long rel;
+
+	it->id = id;
+	it->prod = id - global_args.num_cons;
+	it->prio = 0;
+	it->deadline = 0;
+
+	if (global_args.queue == QUEUE_EDF) {
+		rel = dist_sample(&global_args.deadline, rs);
+		it->deadline = timespec_to_nsec(now) + rel * 1000ULL;
+		it->key = it->deadline;
+		for (rel /= 1000; rel > 0 && it->prio < NR_CLASSES - 1;
+		     rel /= 10)
+			it->prio++;
+	} else if (global_args.queue == QUEUE_PRIO) {
+		it->prio = rand_next(rs) % global_args.nprio;
+	}
+}
+
+/* Called with b->mutex held and b->occupied < BSIZE */
+static inline void buffer_put(buffer_t *b, item_t *it)
+{
+	int i, parent;
+
+	if (global_args.queue == QUEUE_FIFO) {
+		b->buf[b->nextin++] = *it;
+		b->nextin %= BSIZE;
+	} else {
+		/* higher priority first, FIFO within the same priority */
+		if (global_args.queue == QUEUE_PRIO)
+			it->key = (unsigned long long)(NR_CLASSES - 1 -
+						       it->prio) << 56 |
+				  (b->seq++ & ((1ULL << 56) - 1));
+		for (i = b->occupied; i > 0; i = parent) {
+			parent = (i - 1) / 2;
+			if (b->buf[parent].key <= it->key)
+				break;
+			b->buf[i] = b->buf[parent];
+		}
+		b->buf[i] = *it;
+	}
+	b->occupied++;
+
+	/*
+	 * now: either b->occupied < BSIZE and b->nextin is the index
+	 * of the next empty slot in the buffer, or
+	 * b->occupied == BSIZE and b->nextin is the index of the
+	 * next (occupied) slot that will be emptied by a consumer
+	 * (such as b->nextin == b->nextout)
+	 */
+}
+
+/* Called with b->mutex held and b->occupied > 0 */
+static inline void buffer_get(buffer_t *b, item_t *it)
+{
+	item_t *last;
+	int i, child;
+
+	if (global_args.queue == QUEUE_FIFO) {
+		*it = b->buf[b->nextout++];
+		b->nextout %= BSIZE;
+	} else {
+		*it = b->buf[0];
+		last = &b->buf[b->occupied - 1];
+		for (i = 0; (child = 2 * i + 1) < b->occupied - 1; i = child) {
+			if (child + 1 < b->occupied - 1 &&
+			    b->buf[child + 1].key < b->buf[child].key)
+				child++;
+			if (last->key <= b->buf[child].key)
+				break;
+			b->buf[i] = b->buf[child];
+		}
+		b->buf[i] = *last;
+	}
+	b->occupied--;
+
+	/*
+	 * now: either b->occupied > 0 and b->nextout is the index
+	 * of the next occupied slot in the buffer, or
+	 * b->occupied == 0 and b->nextout is the index of the next
+	 * (empty) slot that will be filled by a producer (such as
+	 * b->nextout == b->nextin)
+	 */
+}
+
+/*
+ * Priority ceiling of buffers[i].mutex (-B protect): the highest priority
+ * of the threads that lock it or help on its condvars. Stage i puts items
+ * in and helps on more, stage i + 1 takes them out; annoyers and main
+ * never touch the buffers.
+ */
+static int buffer_ceiling(int i)
+{
+	int put = global_args.stage_prio[i];
+	int get = global_args.stage_prio[i + 1];
+
+	return put > get ? put : get;
+}
+
+/* Take b->mutex, accounting for how long it took */
+static inline void buffer_lock(buffer_t *b, thread_stats_t *st)
+{
+	struct timespec t_req, t_got;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_req);
+	ret = sync_mutex_lock(&b->mutex);
+	if (ret != 0) {
+		printf("buffer mutex lock failed: %s\n", strerror(ret));
+		exit(EXIT_FAILURE);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t_got);
+	hist_add(&st->lock, elapsed_nsec(&t_req, &t_got));
+	st->cnt.locks++;
+}
+
+/*
+ * -t: the absolute timeout of a consumer wait starting now, drawn from
+ * the consumer's generator; NULL without -t.
+ */
+static inline struct timespec *wait_deadline(struct timespec *abstime,
+					     struct rand_state *rs)
+{
+	struct timespec t;
+
+	if (!global_args.timed)
+		return NULL;
+
+	t = usec_to_timespec(dist_sample(&global_args.timeout, rs));
+	clock_gettime(CLOCK_MONOTONIC, abstime);
+	*abstime = timespec_add(abstime, &t);
+
+	return abstime;
+}
+
+/*
+ * Called with b->mutex held, instead of pthread_cond_wait(), or of
+ * pthread_cond_timedwait() if abstime is not NULL.
+ */
+static inline void buffer_wait(buffer_t *b, notify_t *cv, waiters_t *w,
+			       struct timespec *abstime, thread_stats_t *st)
+{
+	struct timespec t_wait, t_woken;
+	unsigned long long wake;
+	int timedout = 0;
+
+	w->waiting++;
+	clock_gettime(CLOCK_MONOTONIC, &t_wait);
+	wake = notify_timedwait(cv, &b->mutex, abstime, &timedout);
+	clock_gettime(CLOCK_MONOTONIC, &t_woken);
+	hist_add(&st->block, elapsed_nsec(&t_wait, &t_woken));
+	if (wake)
+		hist_add(&st->wake, wake);
+	if (timedout) {
+		st->cnt.timeouts++;
+		hist_add(&st->overshoot, elapsed_nsec(abstime, &t_woken));
+	}
+	w->waiting--;
+	/* a spurious wakeup may eat a signal meant for somebody else, that
+	 * only costs one more signal later on */
+	if (w->woken > 0)
+		w->woken--;
+}
+
+/*
+ * Called with b->mutex held after a state change waiters on cv care about.
+ * A signal is only useful if some waiter has not been woken up already;
+ * with -E the others are skipped, so no futex wake is issued for them.
+ */
+static inline void buffer_signal(notify_t *cv, waiters_t *w,
+				 counters_t *cnt)
+{
+	if (w->woken < w->waiting) {
+		w->woken++;
+	} else {
+		cnt->idle++;
+		if (global_args.elide)
+			return;
+	}
+
+	cnt->signals++;
+	notify_signal(cv);
+}
+
+/*
+ * -q: take a free slot (s is queue.slots) or a full one (queue.items) of
+ * a PI queue, accounting for the time spent blocked if there was none.
+ * Consumers pass their generator, for the -t timeouts.
+ */
+static inline void queue_take(pi_sem_t *s, struct rand_state *rs,
+			      thread_stats_t *st)
+{
+	struct timespec t_wait, t_woken, abstime, *deadline = NULL;
+
+	if (pi_sem_trywait(s) == 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_wait);
+	for (;;) {
+		st->cnt.waits++;
+		if (rs)
+			deadline = wait_deadline(&abstime, rs);
+		if (pi_sem_timedwait(s, deadline) == 0)
+			break;
+		clock_gettime(CLOCK_MONOTONIC, &t_woken);
+		st->cnt.timeouts++;
+		hist_add(&st->overshoot, elapsed_nsec(&abstime, &t_woken));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t_woken);
+	hist_add(&st->block, elapsed_nsec(&t_wait, &t_woken));
+}
+
+/*
+ * Payload of a new item, written outside the critical section: straight
+ * into the producer slab, or into its private buffer with -M copy.
+ */
+static inline void payload_produce(item_t *it, int id, int prod,
+				   struct rand_state *rs)
+{
+	long len = dist_sample(&global_args.payload_size, rs);
+	char *p;
+
+	if (len < PAYLOAD_MIN)
+		len = PAYLOAD_MIN;
+	if (len > PAYLOAD_MAX)
+		len = PAYLOAD_MAX;
+	it->len = len;
+
+	if (global_args.payload_copy) {
+		p = scratch[id];
+	} else {
+		/* sized for every item in flight, see setup_payloads() */
+		it->slot = slab_get(&slabs[prod]);
+		if (it->slot < 0) {
+			printf("producer %d out of payload slots\n", prod);
+			exit(EXIT_FAILURE);
+		}
+		p = slab_ptr(&slabs[prod], it->slot);
+	}
+	payload_fill(p, it->len, it->id);
+}
+
+/* -M copy, called with b->mutex held before buffer_put() */
+static inline void payload_copy_in(buffer_t *b, item_t *it, const char *src)
+{
+	it->slot = b->data_free[--b->nfree];
+	memcpy(b->data + (size_t)it->slot * PAYLOAD_MAX, src, it->len);
+}
+
+/* -M copy, called with b->mutex held after buffer_get() */
+static inline void payload_copy_out(buffer_t *b, item_t *it, char *dst)
+{
+	memcpy(dst, b->data + (size_t)it->slot * PAYLOAD_MAX, it->len);
+	b->data_free[b->nfree++] = it->slot;
+}
+
+/* Read the payload of a dequeued item, outside the critical section */
+static inline void payload_consume(item_t *it, int id, thread_stats_t *st)
+{
+	if (global_args.payload_copy) {
+		payload_sum(scratch[id], it->len);
+	} else {
+		payload_sum(slab_ptr(&slabs[it->prod], it->slot), it->len);
+		slab_put(&slabs[it->prod], it->slot);
+	}
+	st->cnt.bytes += it->len;
+}
+
 void *producer(void *d)
 {
 	int ret;
 	struct sched_param param;
 	long id = (long) d;
-	long wait;
-	int item = id;
-	buffer_t *b = &buffer;
-	struct timespec twait, now;
-	cpu_set_t mask;
+	long wait = 0, job;
+	item_t it;
+	int prod = id - global_args.num_cons;
+	buffer_t *b = &buffers[0];
+	thread_stats_t *st = &stats[id];
+	struct timespec twait, now, t_req, t_got, release;
+	struct rand_state rs;
+	trace_cursor_t cursor;
+	struct trace_rec rec;
 	pid_t my_pid = gettid();
 
 	pids[id] = my_pid;
+	rand_seed(&rs, global_args.seed, id);
+	if (global_args.replay_file)
+		trace_cursor_init(&cursor, &replay, prod);
 	
-	if (global_args.affinity) {
-		CPU_ZERO(&mask);
-		CPU_SET(0, &mask);
-		ret = sched_setaffinity(0, sizeof(mask), &mask);
-		if (ret != 0) {
-			printf("pthread_setaffinity failed\n"); 
-			exit(EXIT_FAILURE);
-		}
+	ret = placement_pin(placement_cpu(&global_args.placement, ROLE_PROD,
+					 prod));
+	if (ret != 0) {
+		printf("pthread_setaffinity failed\n"); 
+		exit(EXIT_FAILURE);
 	}
 	
-	param.sched_priority = 92;
+	param.sched_priority = global_args.stage_prio[0];
 	ret = pthread_setschedparam(pthread_self(), 
 				    SCHED_FIFO, 
 				    &param);
@@ -124,55 +625,113 @@ void *producer(void *d)
 	if (global_args.pi_cv_enabled) {
 		if (global_args.ftrace)
 			ftrace_write(marker_fd, "Adding helper thread: pid %d,"
-				     " prio 92\n", my_pid);
-		pthread_cond_helpers_add(&buffer.more, my_pid);
+				     " prio %d\n", my_pid,
+				     param.sched_priority);
+		if (global_args.pi_queue)
+			pi_sem_helpers_add(&b->queue.items, my_pid);
+		else
+			notify_helpers_add(&b->more, my_pid);
 		if (global_args.ftrace)
 			ftrace_write(marker_fd, "[prod %d] helps on cv %p\n",
-				     my_pid, &buffer.more);
+				     my_pid, &b->more);
 	}
 
-	while(!shutdown) {
-		pthread_mutex_lock(&b->mutex);
+	while(!shm->shutdown) {
+		if (global_args.replay_file) {
+			ret = trace_next(&cursor, &rec);
+			if (ret < 0)
+				exit(EXIT_FAILURE);
+			if (ret == 0)
+				break;
+			/* absolute release, so that lateness does not drift */
+			twait = usec_to_timespec(rec.arrival);
+			release = timespec_add(&replay_start, &twait);
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&release, NULL);
+		}
 
-		while (b->occupied >= BSIZE)
-			pthread_cond_wait(&b->less, &b->mutex);
+		clock_gettime(CLOCK_MONOTONIC, &t_req);
+		if (global_args.spin)
+			sync_spin_busy(&b->spin);
+		item_init(&it, id, &t_req, &rs);
+		if (global_args.payload)
+			payload_produce(&it, id, prod, &rs);
+		if (global_args.throughput) {
+			job = global_args.tput_work;
+		} else {
+			if (global_args.replay_file)
+				wait = rec.service;
+			else
+				wait = rand_wait(&rs);
+			job = wait * 1000L;
+		}
+		if (global_args.work_split[WORK_PRE]) {
+			job_work(job, WORK_PRE);
+			clock_gettime(CLOCK_MONOTONIC, &t_req);
+		}
+		if (global_args.pi_queue) {
+			queue_take(&b->queue.slots, NULL, st);
+		} else {
+			buffer_lock(b, st);
+			while (b->occupied >= BSIZE) {
+				st->cnt.waits++;
+				buffer_wait(b, &b->less, &b->less_waiters,
+					    NULL, st);
+				st->cnt.locks++;
+			}
+			assert(b->occupied < BSIZE);
+		}
 
-		assert(b->occupied < BSIZE);
+		clock_gettime(CLOCK_MONOTONIC, &t_got);
+		hist_add(&st->wait, elapsed_nsec(&t_req, &t_got));
 
-		b->buf[b->nextin++] = item;
-		wait = rand_wait() * 1000;
-		twait = usec_to_timespec(wait);
-		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
-		twait = timespec_add(&now, &twait);
-		busywait(&twait);
-		if (global_args.ftrace)
-			ftrace_write(marker_fd, "[prod %d] executed for %d usec"
-				     " and produced %d\n", my_pid, wait, item);
-
-		b->nextin %= BSIZE;
-		b->occupied++;
-
-		/*
-		 * now: either b->occupied < BSIZE and b->nextin is the index
-		 * of the next empty slot in the buffer, or
-		 * b->occupied == BSIZE and b->nextin is the index of the
-		 * next (occupied) slot that will be emptied by a consumer
-		 * (such as b->nextin == b->nextout)
-		 */
+		it.enqueued = timespec_to_nsec(&t_got);
+		it.born = it.enqueued;
+		if (global_args.payload_copy)
+			payload_copy_in(b, &it, scratch[id]);
+		if (global_args.pi_queue)
+			pi_queue_put(&b->queue, &it);
+		else
+			buffer_put(b, &it);
+		job_work(job, WORK_IN);
+		if (global_args.ftrace && !global_args.throughput)
+			ftrace_write(marker_fd, "[prod %d] executed for"
+				     " %d usec and produced %d\n",
+				     my_pid, wait, it.id);
 	
-		pthread_cond_signal(&b->more);
-	
-		pthread_mutex_unlock(&b->mutex);
-		sleep(1);
+		if (!global_args.pi_queue) {
+			buffer_signal(&b->more, &b->more_waiters, &st->cnt);
+			if (global_args.payload) {
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				hist_add(&st->hold,
+					 elapsed_nsec(&t_got, &now));
+			}
+			sync_mutex_unlock(&b->mutex);
+		}
+		if (global_args.spin)
+			sync_spin_idle(&b->spin);
+		job_work(job, WORK_POST);
+		st->cnt.items++;
+
+		if (global_args.replay_file) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			hist_add(&st->release, elapsed_nsec(&release, &now));
+		} else if (!global_args.throughput) {
+			sleep(1);
+		}
 	}
 
 	if (global_args.pi_cv_enabled) {
-		pthread_cond_helpers_del(&buffer.more, my_pid);
+		if (global_args.pi_queue)
+			pi_sem_helpers_del(&b->queue.items, my_pid);
+		else
+			notify_helpers_del(&b->more, my_pid);
 		if (global_args.ftrace) {
 			ftrace_write(marker_fd, "[prod %d] stop helping"
-				     " on cv %p\n", my_pid, &buffer.more);
+				     " on cv %p\n", my_pid, &b->more);
 			ftrace_write(marker_fd, "Removing helper thread:"
-				     " pid %d, prio 92\n", my_pid);
+				     " pid %d, prio %d\n", my_pid,
+				     param.sched_priority);
 		}
 	}
 
@@ -184,27 +743,29 @@ void *consumer(void *d)
 	int ret;
 	struct sched_param param;
 	long id = (long) d;
-	long wait;
-	int item;
-	buffer_t *b = &buffer;
-	struct timespec twait, now;
-	cpu_set_t mask;
+	long wait = 0, job;
+	item_t it;
+	long long late;
+	unsigned long long t_done, t_deq;
+	buffer_t *b = &buffers[global_args.nstages - 2];
+	thread_stats_t *st = &stats[id];
+	sojourn_t *sj = &sojourn[id];
+	struct timespec now, t_req, t_got, abstime;
+	struct rand_state rs;
 	pid_t my_pid = gettid();
 
 	pids[id] = my_pid;
+	rand_seed(&rs, global_args.seed, id);
 	
 
-	if (global_args.affinity) {
-		CPU_ZERO(&mask);
-		CPU_SET(0, &mask);
-		ret = sched_setaffinity(0, sizeof(mask), &mask);
-		if (ret != 0) {
-			printf("pthread_setaffinity failed\n"); 
-			exit(EXIT_FAILURE);
-		}
+	ret = placement_pin(placement_cpu(&global_args.placement, ROLE_CONS,
+					 id));
+	if (ret != 0) {
+		printf("pthread_setaffinity failed\n"); 
+		exit(EXIT_FAILURE);
 	}
 	
-	param.sched_priority = 94;
+	param.sched_priority = global_args.stage_prio[global_args.nstages - 1];
 	ret = pthread_setschedparam(pthread_self(), 
 				    SCHED_FIFO, 
 				    &param);
@@ -213,45 +774,226 @@ void *consumer(void *d)
 		exit(EXIT_FAILURE);
 	}
 	
+	/* with -q consumers give slots back, producers wait for them */
+	if (global_args.pi_cv_enabled && global_args.pi_queue)
+		pi_sem_helpers_add(&b->queue.slots, my_pid);
+
 	/**
 	 * Give producers some time to set up.
 	 */
 	sleep(1);
 
-	while(!shutdown) {
-		pthread_mutex_lock(&b->mutex);
-		while(b->occupied <= 0) {
-			if (global_args.ftrace)
-				ftrace_write(marker_fd, "[cons %d] waits\n",
-					     my_pid);
-			pthread_cond_wait(&b->more, &b->mutex);
+	while(!shm->shutdown) {
+		if (global_args.throughput) {
+			job = global_args.tput_work;
+		} else {
+			wait = rand_wait(&rs);
+			job = wait * 1000L;
 		}
+		job_work(job, WORK_PRE);
+
+		clock_gettime(CLOCK_MONOTONIC, &t_req);
+		if (global_args.pi_queue) {
+			queue_take(&b->queue.items, &rs, st);
+			pi_queue_get(&b->queue, &it);
+		} else {
+			buffer_lock(b, st);
+			/* a producer running elsewhere may be about to put */
+			if (global_args.spin && b->occupied <= 0) {
+				sync_mutex_unlock(&b->mutex);
+				sync_spin_wait(&b->spin, &b->occupied, 0);
+				buffer_lock(b, st);
+			}
+			while(b->occupied <= 0) {
+				if (global_args.ftrace)
+					ftrace_write(marker_fd,
+						     "[cons %d] waits\n",
+						     my_pid);
+				st->cnt.waits++;
+				buffer_wait(b, &b->more, &b->more_waiters,
+					    wait_deadline(&abstime, &rs), st);
+				st->cnt.locks++;
+			}
+			assert(b->occupied > 0);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t_got);
+		hist_add(&st->wait, elapsed_nsec(&t_req, &t_got));
 	
-		assert(b->occupied > 0);
+		if (!global_args.pi_queue)
+			buffer_get(b, &it);
+		t_deq = timespec_to_nsec(&t_got) - it.enqueued;
+		if (global_args.payload_copy)
+			payload_copy_out(b, &it, scratch[id]);
+		job_work(job, WORK_IN);
+		if (global_args.ftrace && !global_args.throughput)
+			ftrace_write(marker_fd, "[cons %d] executed for"
+				     " %d usec and consumed %d\n",
+				     my_pid, wait, it.id);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		t_done = timespec_to_nsec(&now);
+		hist_add(&sj->dequeue[it.prod], t_deq);
+		hist_add(&sj->done[it.prod], t_done - it.enqueued);
+		hist_add(&sj->dequeue_prio[it.prio], t_deq);
+		hist_add(&sj->done_prio[it.prio], t_done - it.enqueued);
+		hist_add(&st->queue, t_deq);
+		hist_add(&st->e2e, t_done - it.born);
+
+		st->done[it.prio]++;
+		if (it.deadline) {
+			late = t_done - it.deadline;
+			if (late > 0)
+				st->late[it.prio]++;
+			hist_add(&st->tardy[it.prio], late > 0 ? late : 0);
+		}
 	
-		item = b->buf[b->nextout++];
-		wait = rand_wait() * 1000;
-		twait = usec_to_timespec(wait);
-		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
-		twait = timespec_add(&now, &twait);
-		busywait(&twait);
+		if (!global_args.pi_queue) {
+			buffer_signal(&b->less, &b->less_waiters, &st->cnt);
+			if (global_args.payload) {
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				hist_add(&st->hold,
+					 elapsed_nsec(&t_got, &now));
+			}
+			sync_mutex_unlock(&b->mutex);
+		}
+		if (global_args.payload)
+			payload_consume(&it, id, st);
+		job_work(job, WORK_POST);
+		st->cnt.items++;
+	}
+
+	if (global_args.pi_cv_enabled && global_args.pi_queue)
+		pi_sem_helpers_del(&b->queue.slots, my_pid);
+
+	pthread_exit(NULL);
+}
+
+/*
+ * Middle stage of a pipeline: take an item from the previous stage, do
+ * the job and pass the item on. A relay produces for the next stage, so
+ * it helps on its condvar exactly like producers do on the first one.
+ */
+void *relay(void *d)
+{
+	int ret, stage;
+	struct sched_param param;
+	long id = (long) d;
+	int relay = id - stage_first[1];
+	long wait = 0, job;
+	item_t it;
+	buffer_t *in, *out;
+	thread_stats_t *st = &stats[id];
+	struct timespec now, t_req, t_got;
+	struct rand_state rs;
+	pid_t my_pid = gettid();
+
+	for (stage = 1; stage < global_args.nstages - 2; stage++)
+		if (id < stage_first[stage + 1])
+			break;
+	in = &buffers[stage - 1];
+	out = &buffers[stage];
+
+	pids[id] = my_pid;
+	rand_seed(&rs, global_args.seed, id);
+
+	ret = placement_pin(placement_cpu(&global_args.placement, ROLE_RELAY,
+					 relay));
+	if (ret != 0) {
+		printf("pthread_setaffinity failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	param.sched_priority = global_args.stage_prio[stage];
+	ret = pthread_setschedparam(pthread_self(),
+				    SCHED_FIFO,
+				    &param);
+	if (ret != 0) {
+		printf("pthread_setschedparam failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (global_args.pi_cv_enabled && global_args.pi_queue) {
+		pi_sem_helpers_add(&out->queue.items, my_pid);
+		pi_sem_helpers_add(&in->queue.slots, my_pid);
+	} else if (global_args.pi_cv_enabled) {
+		notify_helpers_add(&out->more, my_pid);
 		if (global_args.ftrace)
-			ftrace_write(marker_fd, "[cons %d] executed for %d usec"
-				     " and consumed %d\n", my_pid, wait, item);
+			ftrace_write(marker_fd, "[relay %d] stage %d helps on"
+				     " cv %p\n", my_pid, stage, &out->more);
+	}
 
-		b->nextout %= BSIZE;
-		b->occupied--;
-	
-		/*
-		 * now: either b->occupied > 0 and b->nextout is the index
-		 * of the next occupied slot in the buffer, or
-		 * b->occupied == 0 and b->nextout is the index of the next
-		 * (empty) slot that will be filled by a producer (such as
-		 * b->nextout == b->nextin)
-		 */
-	
-		pthread_cond_signal(&b->less);
-		pthread_mutex_unlock(&b->mutex);
+	while(!shm->shutdown) {
+		if (global_args.throughput) {
+			job = global_args.tput_work;
+		} else {
+			wait = rand_wait(&rs);
+			job = wait * 1000L;
+		}
+		job_work(job, WORK_PRE);
+
+		clock_gettime(CLOCK_MONOTONIC, &t_req);
+		if (global_args.pi_queue) {
+			queue_take(&in->queue.items, NULL, st);
+			clock_gettime(CLOCK_MONOTONIC, &t_got);
+			pi_queue_get(&in->queue, &it);
+		} else {
+			buffer_lock(in, st);
+			while (in->occupied <= 0) {
+				st->cnt.waits++;
+				buffer_wait(in, &in->more, &in->more_waiters,
+					    NULL, st);
+				st->cnt.locks++;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t_got);
+			buffer_get(in, &it);
+			buffer_signal(&in->less, &in->less_waiters,
+				      &st->cnt);
+			sync_mutex_unlock(&in->mutex);
+		}
+		hist_add(&st->queue, timespec_to_nsec(&t_got) - it.enqueued);
+		if (global_args.spin)
+			sync_spin_busy(&out->spin);
+
+		if (global_args.pi_queue) {
+			queue_take(&out->queue.slots, NULL, st);
+		} else {
+			buffer_lock(out, st);
+			while (out->occupied >= BSIZE) {
+				st->cnt.waits++;
+				buffer_wait(out, &out->less,
+					    &out->less_waiters, NULL, st);
+				st->cnt.locks++;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		hist_add(&st->wait, elapsed_nsec(&t_req, &now));
+
+		it.enqueued = timespec_to_nsec(&now);
+		if (global_args.pi_queue)
+			pi_queue_put(&out->queue, &it);
+		else
+			buffer_put(out, &it);
+		job_work(job, WORK_IN);
+		if (global_args.ftrace && !global_args.throughput)
+			ftrace_write(marker_fd, "[relay %d] executed for"
+				     " %d usec and passed %d on\n",
+				     my_pid, wait, it.id);
+		if (!global_args.pi_queue) {
+			buffer_signal(&out->more, &out->more_waiters,
+				      &st->cnt);
+			sync_mutex_unlock(&out->mutex);
+		}
+		if (global_args.spin)
+			sync_spin_idle(&out->spin);
+		job_work(job, WORK_POST);
+		st->cnt.items++;
+	}
+
+	if (global_args.pi_cv_enabled && global_args.pi_queue) {
+		pi_sem_helpers_del(&out->queue.items, my_pid);
+		pi_sem_helpers_del(&in->queue.slots, my_pid);
+	} else if (global_args.pi_cv_enabled) {
+		notify_helpers_del(&out->more, my_pid);
 	}
 
 	pthread_exit(NULL);
@@ -261,22 +1003,20 @@ void *annoyer(void *d)
 {
 	int ret;
 	long id = (long) d;
-	struct timespec twait, now;
+	int annoy = id - global_args.num_cons - global_args.num_prod;
+	thread_stats_t *st = &stats[id];
+	struct timespec twait, now, release;
 	struct sched_param param;
-	cpu_set_t mask;
 	pid_t my_pid = gettid();
 
 	pids[id] = my_pid;
 	
 
-	if (global_args.affinity) {
-		CPU_ZERO(&mask);
-		CPU_SET(0, &mask);
-		ret = sched_setaffinity(0, sizeof(mask), &mask);
-		if (ret != 0) {
-			printf("pthread_setaffinity failed\n"); 
-			exit(EXIT_FAILURE);
-		}
+	ret = placement_pin(placement_cpu(&global_args.placement, ROLE_ANNOY,
+					 annoy));
+	if (ret != 0) {
+		printf("pthread_setaffinity failed\n"); 
+		exit(EXIT_FAILURE);
 	}
 	
 	param.sched_priority = 93;
@@ -296,6 +1036,7 @@ void *annoyer(void *d)
 	if (global_args.ftrace)
 		ftrace_write(marker_fd, "Starting annoyer(): prio 93\n");
 
+	clock_gettime(CLOCK_MONOTONIC, &release);
 	while(1) {
 		/* 300ms */
 		twait = usec_to_timespec(300000L);
@@ -306,23 +1047,422 @@ void *annoyer(void *d)
 		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
 		twait = timespec_add(&now, &twait);
 		busywait(&twait);
+		/* anything above us that ran in the meantime shows here */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		hist_add(&st->response, elapsed_nsec(&release, &now));
 		if (global_args.ftrace)
 			ftrace_write(marker_fd,
 				     "[annoyer %d] sleeps.\n",
 				     my_pid);
-		sleep(1);
+		release = now;
+		release.tv_sec++;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &release,
+				NULL);
 	}
 	pthread_exit(NULL);
 }
 
+/*
+ * Per urgency class breakdown of consumed items (whole run): lateness for
+ * EDF, item count for the priority queue.
+ */
+void print_classes(void)
+{
+	static const char *edf_names[NR_CLASSES] = { "deadline < 1ms",
+		"deadline < 10ms", "deadline < 100ms", "deadline >= 100ms" };
+	static hist_t tardy;
+	unsigned long done, late;
+	int c, i;
+
+	for (c = 0; c < NR_CLASSES; c++) {
+		hist_init(&tardy);
+		done = late = 0;
+		for (i = 0; i < global_args.num_cons; i++) {
+			done += stats[i].done[c];
+			late += stats[i].late[c];
+			hist_merge(&tardy, &stats[i].tardy[c]);
+		}
+
+		if (global_args.queue == QUEUE_PRIO) {
+			if (c < global_args.nprio)
+				printf("  prio %d: %lu items\n", c, done);
+			continue;
+		}
+
+		printf("  %s: %lu items, %lu late (%.2f%%)\n", edf_names[c],
+		       done, late, done ? 100.0 * late / done : 0.0);
+		hist_print(stdout, "    tardiness", &tardy);
+	}
+}
+
+/*
+ * Queueing delay (enqueue to dequeue) and sojourn (enqueue to processed)
+ * of consumed items, per producer and per priority class.
+ */
+void print_sojourn(void)
+{
+	static hist_t dequeue, done;
+	char name[32];
+	int p, c, i;
+
+	printf("sojourn per producer:\n");
+	for (p = 0; p < global_args.num_prod; p++) {
+		hist_init(&dequeue);
+		hist_init(&done);
+		for (i = 0; i < global_args.num_cons; i++) {
+			hist_merge(&dequeue, &sojourn[i].dequeue[p]);
+			hist_merge(&done, &sojourn[i].done[p]);
+		}
+		snprintf(name, sizeof(name), "  prod %d to dequeue", p);
+		hist_print(stdout, name, &dequeue);
+		snprintf(name, sizeof(name), "  prod %d to processed", p);
+		hist_print(stdout, name, &done);
+	}
+
+	if (global_args.queue == QUEUE_FIFO)
+		return;
+
+	printf("sojourn per %s:\n", global_args.queue == QUEUE_EDF ?
+	       "deadline class" : "priority");
+	for (c = 0; c < NR_CLASSES; c++) {
+		if (global_args.queue == QUEUE_PRIO && c >= global_args.nprio)
+			break;
+		hist_init(&dequeue);
+		hist_init(&done);
+		for (i = 0; i < global_args.num_cons; i++) {
+			hist_merge(&dequeue, &sojourn[i].dequeue_prio[c]);
+			hist_merge(&done, &sojourn[i].done_prio[c]);
+		}
+		snprintf(name, sizeof(name), "  class %d to dequeue", c);
+		hist_print(stdout, name, &dequeue);
+		snprintf(name, sizeof(name), "  class %d to processed", c);
+		hist_print(stdout, name, &done);
+	}
+}
+
+/*
+ * Throughput and queueing delay of every pipeline stage, and end to end
+ * latency from the first enqueue to the item being processed.
+ */
+void print_pipeline(double secs)
+{
+	static hist_t queue, e2e;
+	unsigned long items;
+	int s, i, first, last;
+
+	printf("pipeline, %d stages:\n", global_args.nstages);
+	for (s = 0; s < global_args.nstages; s++) {
+		first = stage_first[s];
+		last = first + global_args.stage_threads[s];
+		hist_init(&queue);
+		items = 0;
+		for (i = first; i < last; i++) {
+			items += stats[i].cnt.items - warm[i].items;
+			hist_merge(&queue, &stats[i].queue);
+		}
+		printf("  stage %d, %d threads at prio %d: %.1f items/sec\n",
+		       s, global_args.stage_threads[s],
+		       global_args.stage_prio[s], items / secs);
+		if (s)
+			hist_print(stdout, "    queueing", &queue);
+	}
+
+	hist_init(&e2e);
+	for (i = 0; i < global_args.num_cons; i++)
+		hist_merge(&e2e, &stats[i].e2e);
+	hist_print(stdout, "  end to end", &e2e);
+}
+
+/* -w, whole run */
+void print_spin(sync_spin_t *sp)
+{
+	unsigned long spins = sp->spins, hits = sp->hits;
+
+	printf("  adaptive spin: %lu waits polled, %.1f%% of them found an"
+	       " item, %lu parked right away, %d polls on average\n", spins,
+	       spins ? 100.0 * hits / spins : 0.0, sp->skipped, sp->avg);
+}
+
+/*
+ * Merge the per-thread statistics and print them; called by main at the
+ * end of the measurement window, while workers may still be running.
+ * Counters (and futex syscalls) are accounted after warm-up only, over
+ * secs seconds; histograms cover the whole run.
+ */
+void print_stats(double secs, const long long *sys)
+{
+	static hist_t wait, wake, release, hold, lock, block, overshoot;
+	unsigned long items, locks, waits, signals, idle, timeouts;
+	unsigned long consumed = 0;
+	unsigned long long bytes;
+	int i, first, last;
+
+	for (i = 0; i < 2; i++) {
+		first = i ? global_args.num_cons : 0;
+		last = i ? global_args.num_cons + global_args.num_prod :
+			   global_args.num_cons;
+
+		hist_init(&wait);
+		hist_init(&wake);
+		hist_init(&release);
+		hist_init(&hold);
+		hist_init(&lock);
+		hist_init(&block);
+		hist_init(&overshoot);
+		items = locks = waits = signals = idle = timeouts = bytes = 0;
+		for (; first < last; first++) {
+			items += stats[first].cnt.items - warm[first].items;
+			locks += stats[first].cnt.locks - warm[first].locks;
+			waits += stats[first].cnt.waits - warm[first].waits;
+			bytes += stats[first].cnt.bytes - warm[first].bytes;
+			signals += stats[first].cnt.signals -
+				   warm[first].signals;
+			idle += stats[first].cnt.idle - warm[first].idle;
+			timeouts += stats[first].cnt.timeouts -
+				    warm[first].timeouts;
+			hist_merge(&wait, &stats[first].wait);
+			hist_merge(&wake, &stats[first].wake);
+			hist_merge(&release, &stats[first].release);
+			hist_merge(&hold, &stats[first].hold);
+			hist_merge(&lock, &stats[first].lock);
+			hist_merge(&block, &stats[first].block);
+			hist_merge(&overshoot, &stats[first].overshoot);
+		}
+		if (!i)
+			consumed = items;
+
+		printf("%s: %lu items, %.1f items/sec, %.1f locks/sec,"
+		       " %.3f cond waits/item\n",
+		       i ? "producers" : "consumers", items, items / secs,
+		       locks / secs, items ? (double)waits / items : 0.0);
+		hist_print(stdout, i ? "  lock+slot wait" : "  lock+item wait",
+			   &wait);
+		hist_print(stdout, "  mutex lock", &lock);
+		hist_print(stdout, "  cond blocked", &block);
+		hist_print(stdout, "  wake latency", &wake);
+		printf("  %.1f signals/sec, %.1f %s/sec\n", signals / secs,
+		       idle / secs, global_args.elide ? "elided" :
+		       "with no waiter to wake");
+		if (!i && global_args.timed) {
+			printf("  %lu timeouts, %.1f/sec, %.2f%% of cond"
+			       " waits\n", timeouts, timeouts / secs,
+			       waits ? 100.0 * timeouts / waits : 0.0);
+			hist_print(stdout, "  timeout overshoot", &overshoot);
+		}
+		if (!i && global_args.spin)
+			print_spin(&buffers[global_args.nstages - 2].spin);
+		if (i && global_args.replay_file)
+			hist_print(stdout, "  release to enqueue", &release);
+		if (global_args.payload) {
+			hist_print(stdout, "  critical section", &hold);
+			if (!i)
+				printf("  %llu payload bytes, %.1f MB/sec\n",
+				       bytes, bytes / secs / (1024 * 1024));
+		}
+	}
+
+	if (global_args.num_annoy) {
+		hist_init(&wait);
+		for (i = 0; i < global_args.num_annoy; i++)
+			hist_merge(&wait, &stats[global_args.num_cons +
+					  global_args.num_prod + i].response);
+		printf("annoyers:\n");
+		hist_print(stdout, "  300ms burst response", &wait);
+	}
+
+	if (global_args.queue != QUEUE_FIFO)
+		print_classes();
+	print_sojourn();
+	if (global_args.nstages > 2)
+		print_pipeline(secs);
+
+	for (i = 0; i < SYS_NR; i++) {
+		/* only eventfd notifications go through the others */
+		if (i != SYS_FUTEX && global_args.notify != NOTIFY_EVENTFD)
+			break;
+		if (sys[i] < 0)
+			printf("%s syscalls: n/a (sys_enter_%s not available)\n",
+			       syscall_names[i], syscall_names[i]);
+		else
+			printf("%s syscalls: %lld, %.1f/sec, %.3f per item\n",
+			       syscall_names[i], sys[i], sys[i] / secs,
+			       consumed ? (double)sys[i] / consumed : 0.0);
+	}
+	fflush(stdout);
+}
+
+/*
+ * -X THREADS@PRIO,THREADS@PRIO[,...]: first stage are the producers, last
+ * one the consumers, relays in between.
+ */
+int parse_stages(const char *spec)
+{
+	const char *p = spec;
+	int n = 0, len, relays = 0;
+
+	while (*p) {
+		if (n == MAX_STAGES ||
+		    sscanf(p, "%d@%d%n", &global_args.stage_threads[n],
+			   &global_args.stage_prio[n], &len) != 2 ||
+		    global_args.stage_threads[n] < 1 ||
+		    global_args.stage_prio[n] < 1 ||
+		    global_args.stage_prio[n] > 98)
+			return 1;
+		p += len;
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return 1;
+		n++;
+	}
+
+	if (n < 2 || global_args.stage_threads[0] > MAX_PROD ||
+	    global_args.stage_threads[n - 1] > MAX_CONS)
+		return 1;
+
+	global_args.nstages = n;
+	global_args.num_prod = global_args.stage_threads[0];
+	global_args.num_cons = global_args.stage_threads[n - 1];
+	for (n = 1; n < global_args.nstages - 1; n++)
+		relays += global_args.stage_threads[n];
+	global_args.num_relay = relays;
+
+	return relays > MAX_RELAY;
+}
+
+/*
+ * -F: the shared state goes in a POSIX shared memory segment, unlinked as
+ * soon as it is mapped; the workers inherit the mapping across fork().
+ */
+shared_t *shared_map(void)
+{
+	char name[64];
+	shared_t *p;
+	int fd;
+
+	snprintf(name, sizeof(name), "/prod_cons.%d", getpid());
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+		return NULL;
+	shm_unlink(name);
+	if (ftruncate(fd, sizeof(shared_t)) != 0) {
+		close(fd);
+		return NULL;
+	}
+	p = mmap(NULL, sizeof(shared_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+		 fd, 0);
+	close(fd);
+
+	return p == MAP_FAILED ? NULL : p;
+}
+
+/* Start worker id running fn: a thread, or a child process with -F */
+void spawn(pthread_t *thread, pthread_attr_t *attr, void *(*fn)(void *),
+	   long id)
+{
+	pid_t pid;
+
+	if (!global_args.processes) {
+		pthread_create(thread, attr, fn, (void *)id);
+		return;
+	}
+
+	/* or the child flushes our pending output too */
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		printf("fork failed\n");
+		exit(EXIT_FAILURE);
+	}
+	if (pid)
+		return;
+	/* memory locks are not inherited */
+	if (global_args.lock_pages &&
+	    memlock_all(global_args.replay_file != NULL))
+		exit(EXIT_FAILURE);
+	fn((void *)id);
+	exit(EXIT_SUCCESS);
+}
+
+/*
+ * With -m every thread gets its own locked and populated stack, so that
+ * no stack page is faulted in while measuring.
+ */
+void setup_stack(pthread_attr_t *attr, int i)
+{
+	if (!global_args.lock_pages)
+		return;
+
+	stack_sizes[i] = global_args.stack_size;
+	stacks[i] = stack_setup(attr, &stack_sizes[i], global_args.huge_stack);
+	if (!stacks[i])
+		exit(EXIT_FAILURE);
+}
+
+/*
+ * Payload memory is set up once, before threads start: slabs big enough
+ * that a producer never runs out of slots, or the buffer data area and
+ * private copies with -M copy.
+ */
+void setup_payloads(void)
+{
+	int i, nslots;
+
+	if (global_args.payload_copy) {
+		buffers[0].data = malloc((size_t)BSIZE * PAYLOAD_MAX);
+		for (i = 0; buffers[0].data && i < global_args.num_cons +
+						global_args.num_prod; i++) {
+			scratch[i] = malloc(PAYLOAD_MAX);
+			if (!scratch[i])
+				break;
+		}
+		if (!buffers[0].data || i < global_args.num_cons +
+					global_args.num_prod) {
+			printf("cannot allocate payload buffers\n");
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < BSIZE; i++)
+			buffers[0].data_free[i] = i;
+		buffers[0].nfree = BSIZE;
+		if (global_args.lock_pages) {
+			prefault(buffers[0].data, (size_t)BSIZE * PAYLOAD_MAX);
+			for (i = 0; i < global_args.num_cons +
+					global_args.num_prod; i++)
+				prefault(scratch[i], PAYLOAD_MAX);
+		}
+		return;
+	}
+
+	/*
+	 * Every buffer of the pipeline full of one producer's items, plus
+	 * one held by each relay and consumer and the one being filled.
+	 */
+	nslots = (global_args.nstages - 1) * BSIZE + global_args.num_relay +
+		 global_args.num_cons + 1;
+	for (i = 0; i < global_args.num_prod; i++) {
+		if (slab_init(&slabs[i], nslots))
+			exit(EXIT_FAILURE);
+		if (global_args.lock_pages)
+			prefault(slabs[i].mem,
+				 (size_t)slabs[i].nslots * PAYLOAD_MAX);
+	}
+}
+
 int main(int argc, char *argv[])
 {
-	int i, ret, opt = 0; 
+	int i, j, ret, nthreads, opt = 0; 
 	long id = 0;
-	pthread_t threads[MAX_PROD + MAX_CONS + MAX_ANNOY];
+	pthread_t threads[MAX_THREADS];
 	pthread_attr_t attr;
 	struct sched_param param;
-	cpu_set_t mask;
+	struct timespec t_start, t_end, t_warm;
+	struct rusage ru_start, ru_end;
+	boost_stats_t bst;
+	long minflt, majflt;
+	double secs;
+	long long sys_warm[SYS_NR], sys[SYS_NR];
+	int sys_fd[SYS_NR];
+	char *end;
 	char *debugfs;
 	char path[256];
 
@@ -332,7 +1472,10 @@ int main(int argc, char *argv[])
 	global_args.pi_cv_enabled = 0;
 	global_args.ftrace = 0;
 	global_args.duration = 10;
-	global_args.affinity = 0;
+	placement_parse("none", &global_args.placement);
+	global_args.seed = time(NULL);
+	dist_parse("uniform:10000,100000", &global_args.service);
+	global_args.work_split[WORK_IN] = 1;
 
 	opt = getopt(argc, argv, opt_string);
 	while (opt != -1) {
@@ -356,13 +1499,233 @@ int main(int argc, char *argv[])
 			global_args.duration = atoi(optarg);
 			break;
 		case 'A':
-			global_args.affinity = 1;
+			placement_parse("one", &global_args.placement);
+			break;
+		case 'L':
+			if (placement_parse(optarg, &global_args.placement)) {
+				printf("invalid placement %s\n", optarg);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 'S':
+			dist_free(&global_args.service);
+			if (dist_parse(optarg, &global_args.service)) {
+				printf("invalid service time distribution"
+				       " %s\n", optarg);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 's':
+			global_args.seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			global_args.replay_file = optarg;
+			break;
+		case 'm':
+			global_args.lock_pages = 1;
+			global_args.stack_size = strtoul(optarg, &end, 0) * 1024;
+			if (global_args.stack_size == 0)
+				global_args.stack_size = MEMLOCK_STACK_DEFAULT;
+			global_args.huge_stack = strcmp(end, ",huge") == 0;
+			break;
+		case 'T':
+			global_args.throughput = 1;
+			global_args.tput_work = atol(optarg);
+			break;
+		case 'Q':
+			if (strcmp(optarg, "fifo") == 0) {
+				global_args.queue = QUEUE_FIFO;
+			} else if (strncmp(optarg, "edf:", 4) == 0 &&
+				   !dist_parse(optarg + 4,
+					       &global_args.deadline)) {
+				global_args.queue = QUEUE_EDF;
+			} else if (strncmp(optarg, "prio:", 5) == 0 &&
+				   (global_args.nprio = atoi(optarg + 5)) > 0 &&
+				   global_args.nprio <= NR_CLASSES) {
+				global_args.queue = QUEUE_PRIO;
+			} else {
+				printf("invalid queue %s\n", optarg);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 'X':
+			if (parse_stages(optarg)) {
+				printf("invalid pipeline %s\n", optarg);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 'N':
+			ret = notify_parse(optarg);
+			if (ret < 0) {
+				printf("invalid notification backend %s\n",
+				       optarg);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			global_args.notify = ret;
+			break;
+		case 'B':
+			global_args.sync = optarg;
+			break;
+		case 'b':
+			if (sscanf(optarg, "%lu/%lu", &global_args.budget,
+				   &global_args.budget_period) != 2 ||
+			    !global_args.budget ||
+			    global_args.budget > global_args.budget_period) {
+				printf("invalid boost budget %s,"
+				       " RUNTIME/PERIOD (usec)\n", optarg);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 'E':
+			global_args.elide = 1;
+			break;
+		case 'q':
+			global_args.pi_queue = 1;
+			break;
+		case 'F':
+			global_args.processes = 1;
+			break;
+		case 'w':
+			global_args.spin = 1;
+			break;
+		case 't':
+			global_args.timed = 1;
+			dist_free(&global_args.timeout);
+			if (dist_parse(optarg, &global_args.timeout)) {
+				printf("invalid consumer timeout distribution"
+				       " %s\n", optarg);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 'W':
+			if (sscanf(optarg, "%d:%d:%d",
+				   &global_args.work_split[WORK_PRE],
+				   &global_args.work_split[WORK_IN],
+				   &global_args.work_split[WORK_POST]) != 3 ||
+			    global_args.work_split[WORK_PRE] < 0 ||
+			    global_args.work_split[WORK_IN] < 0 ||
+			    global_args.work_split[WORK_POST] < 0) {
+				printf("invalid work split %s\n", optarg);
+				exit(EXIT_INV_COMMANDLINE);
+			}
+			break;
+		case 'M':
+			global_args.payload = 1;
+			global_args.payload_copy = strncmp(optarg, "copy:",
+							   5) == 0;
+			if (dist_parse(optarg + (global_args.payload_copy ?
+						 5 : 0),
+				       &global_args.payload_size)) {
+				printf("invalid payload size distribution"
+				       " %s\n", optarg);
+				exit(EXIT_INV_COMMANDLINE);
+			}
 			break;
 		}
 		
 		opt = getopt(argc, argv, opt_string);
 	}
 
+	/* -P is the same as -N pi-cond, and makes any other backend help */
+	if (global_args.notify == NOTIFY_PI_COND)
+		global_args.pi_cv_enabled = 1;
+	else if (global_args.pi_cv_enabled &&
+		 global_args.notify == NOTIFY_COND)
+		global_args.notify = NOTIFY_PI_COND;
+	if (global_args.pi_cv_enabled &&
+	    global_args.notify == NOTIFY_EVENTFD) {
+		printf("-P is not supported with eventfd notifications\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (sync_backend_setup(global_args.sync, global_args.pi_cv_enabled)) {
+		printf("invalid sync backend %s, one of: %s\n",
+		       global_args.sync, sync_backend_names());
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	/* condvar notifications help exactly when the sync backend does */
+	if (global_args.notify == NOTIFY_COND ||
+	    global_args.notify == NOTIFY_PI_COND) {
+		global_args.pi_cv_enabled = sync_helpers_enabled();
+		global_args.notify = global_args.pi_cv_enabled ?
+				     NOTIFY_PI_COND : NOTIFY_COND;
+	}
+	/* PI queues help (-P) exactly when the sync backend does */
+	if (global_args.pi_queue)
+		global_args.pi_cv_enabled = sync_helpers_enabled();
+	if (global_args.budget && !sync_backend->boost) {
+		printf("-b needs a uboost sync backend\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (global_args.budget &&
+	    boost_set_budget(global_args.budget * 1000ULL,
+			     global_args.budget_period * 1000ULL)) {
+		printf("boost budget watchdog creation failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* a plain producer/consumer run is a two stage pipeline */
+	if (!global_args.nstages) {
+		global_args.nstages = 2;
+		global_args.stage_threads[0] = global_args.num_prod;
+		global_args.stage_threads[1] = global_args.num_cons;
+		global_args.stage_prio[0] = 92;
+		global_args.stage_prio[1] = 94;
+	}
+	stage_first[0] = global_args.num_cons;
+	stage_first[global_args.nstages - 1] = 0;
+	id = global_args.num_cons + global_args.num_prod +
+	     global_args.num_annoy;
+	for (i = 1; i < global_args.nstages - 1; i++) {
+		stage_first[i] = id;
+		id += global_args.stage_threads[i];
+	}
+	nthreads = id;
+	id = 0;
+
+	if (global_args.payload_copy && global_args.nstages > 2) {
+		printf("-M copy: and -X with relays are mutually exclusive\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (global_args.pi_queue &&
+	    (global_args.queue != QUEUE_FIFO || global_args.payload_copy ||
+	     global_args.elide || global_args.spin)) {
+		printf("-q only supports -Q fifo, no -M copy:, no -E and no"
+		       " -w\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (global_args.processes &&
+	    (global_args.pi_queue || global_args.payload ||
+	     (global_args.notify != NOTIFY_COND &&
+	      global_args.notify != NOTIFY_PI_COND))) {
+		printf("-F only supports condvar notifications, no -q and"
+		       " no -M\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (global_args.processes && sync_backend_set_shared()) {
+		printf("-F is not supported with the %s sync backend\n",
+		       sync_backend->name);
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (global_args.processes) {
+		shm = shared_map();
+		if (!shm) {
+			printf("shared memory segment setup failed\n");
+			exit(EXIT_FAILURE);
+		}
+		buffers = shm->buffers;
+		pids = shm->pids;
+		stats = shm->stats;
+		sojourn = shm->sojourn;
+	}
+
+	global_args.work_total = global_args.work_split[WORK_PRE] +
+				 global_args.work_split[WORK_IN] +
+				 global_args.work_split[WORK_POST];
+	if (global_args.work_total == 0) {
+		printf("invalid work split, all ratios are 0\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+
 	if (global_args.ftrace) {
 		debugfs = "/debug";
 		strcpy(path, debugfs);
@@ -377,14 +1740,21 @@ int main(int argc, char *argv[])
 	}
 	
 
-	if (global_args.affinity) {
-		CPU_ZERO(&mask);
-		CPU_SET(1, &mask);
-		ret = sched_setaffinity(0, sizeof(mask), &mask);
-		if (ret != 0) {
-			printf("pthread_setaffinity failed\n"); 
-			exit(EXIT_FAILURE);
-		}
+	if (topology_read(&topology))
+		exit(EXIT_FAILURE);
+	global_args.placement.nthreads[ROLE_PROD] = global_args.num_prod;
+	global_args.placement.nthreads[ROLE_CONS] = global_args.num_cons;
+	global_args.placement.nthreads[ROLE_ANNOY] = global_args.num_annoy;
+	global_args.placement.nthreads[ROLE_RELAY] = global_args.num_relay;
+	if (placement_resolve(&global_args.placement, &topology))
+		exit(EXIT_INV_CONFIG);
+	placement_print(stdout, &global_args.placement, &topology);
+
+	ret = placement_pin(placement_cpu(&global_args.placement, ROLE_MAIN,
+					  0));
+	if (ret != 0) {
+		printf("pthread_setaffinity failed\n"); 
+		exit(EXIT_FAILURE);
 	}
 	
 	param.sched_priority = 99;
@@ -396,23 +1766,154 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	srand(time(NULL));
+	dist_to_string(&global_args.service, path, sizeof(path));
+	printf("Main(): seed %lu, service time %s usec\n", global_args.seed,
+	       path);
+	printf("Main(): work split %d:%d:%d (pre-lock:in-lock:post-lock)\n",
+	       global_args.work_split[WORK_PRE],
+	       global_args.work_split[WORK_IN],
+	       global_args.work_split[WORK_POST]);
+
+	/*
+	 * Lock before mapping the replay trace: with MCL_ONFAULT the trace is
+	 * not populated, trace_open() unlocks it and it is streamed as usual.
+	 */
+	if (global_args.lock_pages) {
+		if (memlock_all(global_args.replay_file != NULL))
+			exit(EXIT_FAILURE);
+		prefault(shm, sizeof(*shm));
+		printf("Main(): memory locked, %zu KB%s thread stacks\n",
+		       global_args.stack_size / 1024,
+		       global_args.huge_stack ? " huge page" : "");
+	}
+
+	if (global_args.replay_file) {
+		if (trace_open(global_args.replay_file, global_args.num_prod,
+			       &replay))
+			exit(EXIT_INV_CONFIG);
+		printf("Main(): replaying %s (%s)\n", global_args.replay_file,
+		       replay.binary ? "binary" : "csv");
+	}
+
+	for (i = 0; i < MAX_THREADS; i++) {
+		hist_init(&stats[i].wait);
+		hist_init(&stats[i].wake);
+		hist_init(&stats[i].release);
+		hist_init(&stats[i].hold);
+		hist_init(&stats[i].lock);
+		hist_init(&stats[i].block);
+		hist_init(&stats[i].overshoot);
+		hist_init(&stats[i].queue);
+		hist_init(&stats[i].e2e);
+		hist_init(&stats[i].response);
+		for (j = 0; j < NR_CLASSES; j++)
+			hist_init(&stats[i].tardy[j]);
+	}
+	for (i = 0; i < MAX_CONS; i++) {
+		for (j = 0; j < MAX_PROD; j++) {
+			hist_init(&sojourn[i].dequeue[j]);
+			hist_init(&sojourn[i].done[j]);
+		}
+		for (j = 0; j < NR_CLASSES; j++) {
+			hist_init(&sojourn[i].dequeue_prio[j]);
+			hist_init(&sojourn[i].done_prio[j]);
+		}
+	}
+
+	if (global_args.queue == QUEUE_EDF) {
+		dist_to_string(&global_args.deadline, path, sizeof(path));
+		printf("Main(): EDF queue, relative deadline %s usec\n", path);
+	} else if (global_args.queue == QUEUE_PRIO) {
+		printf("Main(): priority queue, %d levels\n",
+		       global_args.nprio);
+	}
 	
+	if (global_args.nstages > 2) {
+		printf("Main(): %d stage pipeline:", global_args.nstages);
+		for (i = 0; i < global_args.nstages; i++)
+			printf(" %d@%d", global_args.stage_threads[i],
+			       global_args.stage_prio[i]);
+		printf("\n");
+	}
+
+	if (global_args.pi_queue)
+		printf("Main(): PI queue buffers, %s sync backend\n",
+		       sync_backend->name);
+	else
+		printf("Main(): %s notifications, %s sync backend\n",
+		       notify_name(global_args.notify), sync_backend->name);
+	if (global_args.processes)
+		printf("Main(): one process per thread, %zu KB shared"
+		       " segment\n", sizeof(*shm) / 1024);
+
 	/* Initialize mutex and condition variable objects */
-	pthread_mutexattr_init(&buffer.mutex_attr);
-	pthread_mutexattr_setprotocol(&buffer.mutex_attr, PTHREAD_PRIO_INHERIT);
-	pthread_mutex_init(&buffer.mutex, &buffer.mutex_attr);
-	pthread_cond_init (&buffer.more, NULL);
-	pthread_cond_init (&buffer.less, NULL);
+	for (i = 0; i < global_args.nstages - 1; i++) {
+		ret = sync_mutex_init(&buffers[i].mutex, buffer_ceiling(i));
+		if (ret != 0) {
+			printf("buffer mutex init failed: %s\n",
+			       strerror(ret));
+			exit(EXIT_FAILURE);
+		}
+		if (!strcmp(sync_backend->name, "protect"))
+			printf("Main(): buffer %d priority ceiling %d\n", i,
+			       buffer_ceiling(i));
+		if (notify_init(&buffers[i].more, global_args.notify) ||
+		    notify_init(&buffers[i].less, global_args.notify))
+			exit(EXIT_FAILURE);
+		sync_spin_init(&buffers[i].spin);
+		if (!global_args.pi_queue)
+			continue;
+		ret = pi_queue_init(&buffers[i].queue, BSIZE, sizeof(item_t));
+		if (ret != 0) {
+			printf("buffer queue init failed: %s\n",
+			       strerror(ret));
+			exit(EXIT_FAILURE);
+		}
+	}
 	
 	/* For portability, explicitly create threads in a joinable state */
 	pthread_attr_init(&attr);
 	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	if (global_args.throughput && global_args.replay_file) {
+		printf("-T and -r are mutually exclusive\n");
+		exit(EXIT_INV_COMMANDLINE);
+	}
+	if (global_args.throughput)
+		printf("Main(): throughput mode, %ld nsec in-lock work\n",
+		       global_args.tput_work);
+	if (global_args.elide)
+		printf("Main(): signaling only unwoken waiters\n");
+	if (global_args.spin)
+		printf("Main(): consumers poll an empty buffer before"
+		       " parking\n");
+	if (global_args.timed) {
+		dist_to_string(&global_args.timeout, path, sizeof(path));
+		printf("Main(): consumers time out after %s usec\n", path);
+	}
+
+	if (global_args.payload) {
+		setup_payloads();
+		dist_to_string(&global_args.payload_size, path, sizeof(path));
+		printf("Main(): %s payloads, %s bytes (%d to %d)\n",
+		       global_args.payload_copy ? "copy-in/copy-out" :
+		       "zero-copy", path, PAYLOAD_MIN, PAYLOAD_MAX);
+	}
+
+	/* opened before any thread is created, so that they inherit it */
+	for (i = 0; i < SYS_NR; i++)
+		sys_fd[i] = syscount_open(syscall_names[i]);
+
+	/* replay starts once consumers are done setting up */
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	replay_start = t_start;
+	replay_start.tv_sec += 2;
 	
 	for (i = 0; i < global_args.num_cons; i++) {
 		if (global_args.ftrace)
 			ftrace_write(marker_fd, "[main]: creating consumer()\n");
-		pthread_create(&threads[i], &attr, consumer, (void *)id);
+		setup_stack(&attr, i);
+		spawn(&threads[i], &attr, consumer, id);
 		id++;
 	}
 
@@ -420,7 +1921,8 @@ int main(int argc, char *argv[])
 					    global_args.num_prod); i++) {
 		if (global_args.ftrace)
 			ftrace_write(marker_fd, "[main]: creating producer()\n");
-		pthread_create(&threads[i], &attr, producer, (void *)id);
+		setup_stack(&attr, i);
+		spawn(&threads[i], &attr, producer, id);
 		id++;
 	}
 
@@ -428,33 +1930,107 @@ int main(int argc, char *argv[])
 		    global_args.num_annoy); i++) {
 		if (global_args.ftrace)
 			ftrace_write(marker_fd, "[main]: creating annoyer()\n");
-		pthread_create(&threads[i], &attr, annoyer, (void *)id);
+		setup_stack(&attr, i);
+		spawn(&threads[i], &attr, annoyer, id);
 		id++;
 	}
 
-	sleep(global_args.duration);
-	shutdown = 1;
-	for (i = 0; i < (global_args.num_cons + global_args.num_prod +
-			 global_args.num_annoy); i++) {
-		kill(pids[i], 9);
+	for (; i < nthreads; i++) {
+		if (global_args.ftrace)
+			ftrace_write(marker_fd, "[main]: creating relay()\n");
+		setup_stack(&attr, i);
+		spawn(&threads[i], &attr, relay, id);
+		id++;
+	}
+
+	/* faults and counters are accounted once every thread is set up */
+	t_end = t_start;
+	t_end.tv_sec += global_args.duration;
+	if (timespec_lower(&replay_start, &t_end))
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &replay_start,
+				NULL);
+	getrusage(RUSAGE_SELF, &ru_start);
+	for (i = 0; i < MAX_THREADS; i++)
+		warm[i] = stats[i].cnt;
+	for (i = 0; i < SYS_NR; i++)
+		sys_warm[i] = syscount_read(sys_fd[i]);
+	if (sync_backend->boost)
+		boost_reset_stats();
+	clock_gettime(CLOCK_MONOTONIC, &t_warm);
+
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t_end, NULL);
+	shm->shutdown = 1;
+	faults_delta(&ru_start, &minflt, &majflt);
+	getrusage(RUSAGE_SELF, &ru_end);
+	for (i = 0; i < SYS_NR; i++)
+		sys[i] = sys_warm[i] < 0 ? -1 :
+			 syscount_read(sys_fd[i]) - sys_warm[i];
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	secs = elapsed_nsec(&t_warm, &t_end) / 1E9;
+	print_stats(secs, sys);
+	printf("page faults after warm-up: %ld minor, %ld major%s\n", minflt,
+	       majflt, global_args.processes ? " (main process only)" : "");
+	printf("context switches after warm-up: %.1f voluntary/sec,"
+	       " %.1f involuntary/sec%s\n",
+	       (ru_end.ru_nvcsw - ru_start.ru_nvcsw) / secs,
+	       (ru_end.ru_nivcsw - ru_start.ru_nivcsw) / secs,
+	       global_args.processes ? " (main process only)" : "");
+	if (sync_backend->boost) {
+		boost_get_stats(&bst);
+		boost_stats_print(stdout, &bst);
+	}
+	fflush(stdout);
+
+	for (i = 0; i < nthreads; i++) {
+		/* 0 is our whole process group */
+		if (pids[i])
+			kill(pids[i], 9);
 	}
 	
 	/* Wait for all threads to complete */
-	for (i = 0; i < (global_args.num_cons + global_args.num_prod +
-			 global_args.num_annoy); i++) {
-		pthread_join(threads[i], NULL);
+	for (i = 0; i < nthreads; i++) {
+		if (global_args.processes)
+			wait(NULL);
+		else
+			pthread_join(threads[i], NULL);
 	}
 	printf ("Main(): Waited and joined with %d threads. Done.\n", 
-		global_args.num_cons + global_args.num_prod +
-		global_args.num_annoy);
+		nthreads);
 	
 	if (global_args.ftrace && trace_fd >= 0)
 	        write(trace_fd, "0", 1);
 
 	/* Clean up and exit */
 	pthread_attr_destroy(&attr);
-	pthread_mutex_destroy(&buffer.mutex);
-	pthread_cond_destroy(&buffer.more);
-	pthread_cond_destroy(&buffer.less);
+	/*
+	 * With -F the children were killed wherever they were, possibly
+	 * waiting on a process-shared glibc condvar, whose destroy would
+	 * then wait forever for them to leave: unmapping is enough.
+	 */
+	for (i = 0; !global_args.processes &&
+		    i < global_args.nstages - 1; i++) {
+		sync_mutex_destroy(&buffers[i].mutex);
+		notify_destroy(&buffers[i].more);
+		notify_destroy(&buffers[i].less);
+		if (global_args.pi_queue)
+			pi_queue_destroy(&buffers[i].queue);
+	}
+	dist_free(&global_args.service);
+	dist_free(&global_args.deadline);
+	dist_free(&global_args.payload_size);
+	dist_free(&global_args.timeout);
+	for (i = 0; i < MAX_PROD; i++)
+		slab_destroy(&slabs[i]);
+	for (i = 0; i < MAX_PROD + MAX_CONS; i++)
+		free(scratch[i]);
+	free(buffers[0].data);
+	trace_close(&replay);
+	placement_free(&global_args.placement);
+	for (i = 0; i < SYS_NR; i++)
+		syscount_close(sys_fd[i]);
+	for (i = 0; i < MAX_THREADS; i++)
+		stack_free(stacks[i], stack_sizes[i]);
+	if (global_args.processes)
+		munmap(shm, sizeof(*shm));
 	pthread_exit (NULL);
 }
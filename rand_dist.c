@@ -0,0 +1,293 @@
+/******************************************************************************
+* FILE: rand_dist.c
+* DESCRIPTION:
+*  xoshiro256** generator and service time distributions, see rand_dist.h.
+******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rand_dist.h"
+#include "rt-app_utils.h"
+
+#define CDF_INIT_LEN	64
+
+static inline uint64_t rotl(const uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+uint64_t rand_next(struct rand_state *r)
+{
+	uint64_t *s = r->s;
+	const uint64_t result = rotl(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+
+	return result;
+}
+
+/*
+ * Equivalent to 2^128 calls to rand_next(): gives non-overlapping
+ * sequences to different threads seeded from the same value.
+ */
+static void rand_jump(struct rand_state *r)
+{
+	static const uint64_t jump[] = { 0x180ec6d33cfd0abaULL,
+					 0xd5a61266f0c9392cULL,
+					 0xa9582618e03fc9aaULL,
+					 0x39abdc4529b1661cULL };
+	uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int i, b;
+
+	for (i = 0; i < 4; i++) {
+		for (b = 0; b < 64; b++) {
+			if (jump[i] & (1ULL << b)) {
+				s0 ^= r->s[0];
+				s1 ^= r->s[1];
+				s2 ^= r->s[2];
+				s3 ^= r->s[3];
+			}
+			rand_next(r);
+		}
+	}
+
+	r->s[0] = s0;
+	r->s[1] = s1;
+	r->s[2] = s2;
+	r->s[3] = s3;
+}
+
+void rand_seed(struct rand_state *r, uint64_t seed, unsigned int stream)
+{
+	uint64_t x = seed;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r->s[i] = splitmix64(&x);
+
+	while (stream--)
+		rand_jump(r);
+}
+
+double rand_double(struct rand_state *r)
+{
+	/* 53 random bits, uniform in [0, 1) */
+	return (rand_next(r) >> 11) * 0x1.0p-53;
+}
+
+static double rand_normal(struct rand_state *r)
+{
+	double u1, u2;
+
+	do {
+		u1 = rand_double(r);
+	} while (u1 == 0.0);
+	u2 = rand_double(r);
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static int load_cdf(const char *path, dist_t *d)
+{
+	FILE *f;
+	char line[256];
+	double val, prob, last = 0.0;
+	double *tmp;
+	int size = CDF_INIT_LEN;
+
+	f = fopen(path, "r");
+	if (!f) {
+		log_error("cannot open CDF file %s", path);
+		return 1;
+	}
+
+	d->cdf_len = 0;
+	d->cdf_val = malloc(size * sizeof(double));
+	d->cdf_prob = malloc(size * sizeof(double));
+	if (!d->cdf_val || !d->cdf_prob)
+		goto err;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%lf %lf", &val, &prob) != 2) {
+			log_error("malformed line in %s: %s", path, line);
+			goto err;
+		}
+		if (prob < last || prob > 1.0) {
+			log_error("CDF in %s is not monotonic in [0, 1]", path);
+			goto err;
+		}
+		if (d->cdf_len == size) {
+			size *= 2;
+			if (!(tmp = realloc(d->cdf_val, size * sizeof(double))))
+				goto err;
+			d->cdf_val = tmp;
+			if (!(tmp = realloc(d->cdf_prob, size * sizeof(double))))
+				goto err;
+			d->cdf_prob = tmp;
+		}
+		d->cdf_val[d->cdf_len] = val;
+		d->cdf_prob[d->cdf_len] = prob;
+		d->cdf_len++;
+		last = prob;
+	}
+
+	if (d->cdf_len == 0) {
+		log_error("empty CDF file %s", path);
+		goto err;
+	}
+
+	fclose(f);
+	return 0;
+
+err:
+	fclose(f);
+	dist_free(d);
+	return 1;
+}
+
+int dist_parse(const char *spec, dist_t *d)
+{
+	const char *arg = strchr(spec, ':');
+	int n;
+
+	memset(d, 0, sizeof(*d));
+
+	if (!arg)
+		return 1;
+	arg++;
+
+	if (strncmp(spec, "const:", 6) == 0) {
+		d->type = DIST_CONST;
+		n = sscanf(arg, "%lf", &d->a);
+		return n != 1;
+	} else if (strncmp(spec, "uniform:", 8) == 0) {
+		d->type = DIST_UNIFORM;
+		n = sscanf(arg, "%lf,%lf", &d->a, &d->b);
+		return n != 2 || d->b < d->a;
+	} else if (strncmp(spec, "exp:", 4) == 0) {
+		d->type = DIST_EXP;
+		n = sscanf(arg, "%lf", &d->a);
+		return n != 1 || d->a <= 0;
+	} else if (strncmp(spec, "bimodal:", 8) == 0) {
+		d->type = DIST_BIMODAL;
+		n = sscanf(arg, "%lf,%lf,%lf", &d->a, &d->b, &d->c);
+		return n != 3 || d->c < 0 || d->c > 1;
+	} else if (strncmp(spec, "lognormal:", 10) == 0) {
+		d->type = DIST_LOGNORMAL;
+		n = sscanf(arg, "%lf,%lf", &d->a, &d->b);
+		return n != 2 || d->a <= 0 || d->b < 0;
+	} else if (strncmp(spec, "empirical:", 10) == 0) {
+		d->type = DIST_EMPIRICAL;
+		return load_cdf(arg, d);
+	}
+
+	return 1;
+}
+
+void dist_free(dist_t *d)
+{
+	free(d->cdf_val);
+	free(d->cdf_prob);
+	d->cdf_val = NULL;
+	d->cdf_prob = NULL;
+	d->cdf_len = 0;
+}
+
+static double sample_cdf(const dist_t *d, double u)
+{
+	int lo = 0, hi = d->cdf_len - 1, mid;
+	double p0, v0;
+
+	/* first point whose cumulative probability is >= u */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (d->cdf_prob[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0) {
+		p0 = 0.0;
+		v0 = d->cdf_val[0];
+	} else {
+		p0 = d->cdf_prob[lo - 1];
+		v0 = d->cdf_val[lo - 1];
+	}
+
+	if (d->cdf_prob[lo] <= p0)
+		return d->cdf_val[lo];
+
+	/* linear interpolation between the two points */
+	return v0 + (d->cdf_val[lo] - v0) * (u - p0) / (d->cdf_prob[lo] - p0);
+}
+
+long dist_sample(const dist_t *d, struct rand_state *r)
+{
+	double v = 0.0;
+
+	switch (d->type) {
+	case DIST_CONST:
+		v = d->a;
+		break;
+	case DIST_UNIFORM:
+		v = d->a + (d->b - d->a) * rand_double(r);
+		break;
+	case DIST_EXP:
+		v = -d->a * log(1.0 - rand_double(r));
+		break;
+	case DIST_BIMODAL:
+		v = rand_double(r) < d->c ? d->a : d->b;
+		break;
+	case DIST_LOGNORMAL:
+		v = d->a * exp(d->b * rand_normal(r));
+		break;
+	case DIST_EMPIRICAL:
+		v = sample_cdf(d, rand_double(r));
+		break;
+	}
+
+	if (v < 0.0)
+		v = 0.0;
+
+	return lround(v);
+}
+
+int dist_to_string(const dist_t *d, char *buf, int len)
+{
+	switch (d->type) {
+	case DIST_CONST:
+		return snprintf(buf, len, "const:%.0f", d->a);
+	case DIST_UNIFORM:
+		return snprintf(buf, len, "uniform:%.0f,%.0f", d->a, d->b);
+	case DIST_EXP:
+		return snprintf(buf, len, "exp:%.0f", d->a);
+	case DIST_BIMODAL:
+		return snprintf(buf, len, "bimodal:%.0f,%.0f,%.2f",
+				d->a, d->b, d->c);
+	case DIST_LOGNORMAL:
+		return snprintf(buf, len, "lognormal:%.0f,%.2f", d->a, d->b);
+	case DIST_EMPIRICAL:
+		return snprintf(buf, len, "empirical:%d points", d->cdf_len);
+	}
+
+	return snprintf(buf, len, "unknown");
+}
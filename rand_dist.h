@@ -0,0 +1,64 @@
+/******************************************************************************
+* FILE: rand_dist.h
+* DESCRIPTION:
+*  Per-thread pseudo random number generator (xoshiro256**) and the service
+*  time distributions used by the test programs.
+*
+*  Every thread owns its own struct rand_state, so drawing a random number
+*  never touches shared state (unlike rand(), which takes glibc's internal
+*  lock). Streams are derived from a single seed by jumping 2^128 steps per
+*  stream, so a run can be reproduced from the seed alone.
+******************************************************************************/
+#ifndef _RAND_DIST_H_
+#define _RAND_DIST_H_
+
+#include <stdint.h>
+
+struct rand_state {
+	uint64_t s[4];
+};
+
+typedef enum dist_type_t
+{
+	DIST_CONST = 0,
+	DIST_UNIFORM,
+	DIST_EXP,
+	DIST_BIMODAL,
+	DIST_LOGNORMAL,
+	DIST_EMPIRICAL
+} dist_type_t;
+
+/*
+ * All values are expressed in usec.
+ *
+ *  const:V		always V
+ *  uniform:MIN,MAX	uniform in [MIN, MAX]
+ *  exp:MEAN		exponential with the given mean
+ *  bimodal:A,B,P	A with probability P, B otherwise
+ *  lognormal:MED,SIGMA	lognormal with median MED and shape SIGMA
+ *  empirical:FILE	inverse of the CDF read from FILE, one
+ *			"value cumulative_probability" pair per line
+ */
+typedef struct _dist_t {
+	dist_type_t type;
+	double a, b, c;
+	double *cdf_val;
+	double *cdf_prob;
+	int cdf_len;
+} dist_t;
+
+void rand_seed(struct rand_state *r, uint64_t seed, unsigned int stream);
+
+uint64_t rand_next(struct rand_state *r);
+
+double rand_double(struct rand_state *r);
+
+int dist_parse(const char *spec, dist_t *d);
+
+void dist_free(dist_t *d);
+
+long dist_sample(const dist_t *d, struct rand_state *r);
+
+int dist_to_string(const dist_t *d, char *buf, int len);
+
+#endif /* _RAND_DIST_H_ */
@@ -82,7 +82,6 @@ typedef struct _rtapp_tasks_resource_list_t {
 typedef struct _thread_data_t {
 	int ind;
 	char *name;
-	int lock_pages;
 	int duration;
 	cpu_set_t *cpuset;
 	char *cpuset_str;
@@ -117,8 +116,6 @@ typedef struct _ftrace_data_t {
 } ftrace_data_t;
 
 typedef struct _rtapp_options_t {
-	int lock_pages;
-	
 	thread_data_t *threads_data;
 	int nthreads;
 	
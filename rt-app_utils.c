@@ -37,13 +37,11 @@ timespec_to_usec(struct timespec *ts)
 	return round((ts->tv_sec * 1E9 + ts->tv_nsec) / 1000.0);
 }
 
-#ifdef DLSCHED
-__u64
+unsigned long long
 timespec_to_nsec(struct timespec *ts)
 {
-	return round(ts->tv_sec * 1E9 + ts->tv_nsec);
+	return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
 }
-#endif
 
 struct timespec 
 usec_to_timespec(unsigned long usec)
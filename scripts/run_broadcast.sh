@@ -0,0 +1,25 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${2?"Usage: $0 ITERATIONS RESULTS_PATH"}
+
+ITERATIONS=$1
+RESULTS_PATH=$2
+
+mkdir -p ${RESULTS_PATH}
+
+# glibc PI mutex, plain futex and wait morphing onto the PI mutex
+for b in pi futex pi-requeue; do
+    printf "broadcast to 2..256 waiters, ${b}\n"
+    ./broadcast_bench -B ${b} -i ${ITERATIONS} \
+      > ${RESULTS_PATH}/broadcast_${b}.txt
+    sleep 2
+done
+
+grep -H "waiters,\|first waiter\|last waiter\|context switches" \
+  ${RESULTS_PATH}/broadcast_*.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,34 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${6?"Usage: $0 DURATION RESULTS_PATH PERIOD_USEC PROD CONS ANNOY"}
+
+DURATION=$1
+RESULTS_PATH=$2
+PERIOD=$3
+PROD=$4
+CONS=$5
+ANNOY=$6
+
+mkdir -p ${RESULTS_PATH}
+
+# unbounded helper boosts, then budgets of 50%, 20% and 5% of the period
+for pct in 0 50 20 5; do
+    budget=""
+    if [ ${pct} -ne 0 ]; then
+        budget="-b $((PERIOD * pct / 100))/${PERIOD}"
+    fi
+    printf "${PROD} prod, ${CONS} cons, ${ANNOY} annoy, budget ${pct}%%\n"
+    ./prod_cons -P -B uboost ${budget} -p ${PROD} -c ${CONS} -a ${ANNOY} \
+      -d ${DURATION} \
+      > ${RESULTS_PATH}/budget_${pct}_${PROD}prod_${CONS}cons_${ANNOY}annoy.txt
+    sleep 2
+done
+
+grep -H "cond blocked\|burst response\|expired" \
+  ${RESULTS_PATH}/budget_*_${PROD}prod_${CONS}cons_${ANNOY}annoy.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${2?"Usage: $0 ITERATIONS RESULTS_PATH"}
+
+ITERATIONS=$1
+RESULTS_PATH=$2
+
+mkdir -p ${RESULTS_PATH}
+
+# no condvar boosting, kernel helpers, userspace transitive boosting
+for b in pi pi-cond uboost; do
+    printf "chain depth 1..32, ${b}\n"
+    ./chain_bench -B ${b} -D 1,2,4,8,16,32 -i ${ITERATIONS} \
+      > ${RESULTS_PATH}/chain_${b}.txt
+    sleep 2
+done
+
+grep -H "depth\|boost reach\|waiter blocked" ${RESULTS_PATH}/chain_*.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
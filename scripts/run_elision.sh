@@ -0,0 +1,39 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${3?"Usage: $0 DURATION RESULTS_PATH WORK_NSEC"}
+
+DURATION=$1
+RESULTS_PATH=$2
+WORK=$3
+
+mkdir -p ${RESULTS_PATH}
+
+for n in `seq 1 4`; do
+    for PI in "" "-P"; do
+        NAME=${n}prod_${n}cons${PI:+_pi}
+
+        # signal after every item
+        printf "${n} prod, ${n} cons, ${PI:-no PI}, always signal\n"
+        ./prod_cons ${PI} -T ${WORK} -p ${n} -c ${n} -a 0 -d ${DURATION} \
+          > ${RESULTS_PATH}/signal_${NAME}.txt
+
+        sleep 2
+
+        # signal elision
+        printf "${n} prod, ${n} cons, ${PI:-no PI}, elided signals\n"
+        ./prod_cons ${PI} -E -T ${WORK} -p ${n} -c ${n} -a 0 -d ${DURATION} \
+          > ${RESULTS_PATH}/elide_${NAME}.txt
+
+        sleep 2
+
+        # futex wakes saved/sec is the difference of the futex rates
+        grep -H "signals/sec\|futex" ${RESULTS_PATH}/signal_${NAME}.txt \
+          ${RESULTS_PATH}/elide_${NAME}.txt
+    done
+done
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,26 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${3?"Usage: $0 ITERATIONS CONDVARS RESULTS_PATH"}
+
+ITERATIONS=$1
+CONDVARS=$2
+RESULTS_PATH=$3
+
+mkdir -p ${RESULTS_PATH}
+
+# groups emulated on kernel helpers, native userspace groups
+for b in pi-cond uboost; do
+    printf "group size 1..256, ${CONDVARS} condvars, ${b}\n"
+    ./group_bench -B ${b} -g 1,4,16,64,256 -k ${CONDVARS} \
+      -i ${ITERATIONS} > ${RESULTS_PATH}/groups_${b}_${CONDVARS}conds.txt
+    sleep 2
+done
+
+grep -H "group of\|attach\|join\|leave\|signal\|wake" \
+  ${RESULTS_PATH}/groups_*_${CONDVARS}conds.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
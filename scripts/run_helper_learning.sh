@@ -0,0 +1,32 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${6?"Usage: $0 DURATION RESULTS_PATH WINDOW_USEC PROD CONS ANNOY"}
+
+DURATION=$1
+RESULTS_PATH=$2
+WINDOW=$3
+PROD=$4
+CONS=$5
+ANNOY=$6
+
+mkdir -p ${RESULTS_PATH}
+
+# helpers registered by hand, then learned from the signalers
+for b in uboost uboost-auto:${WINDOW}; do
+    printf "${PROD} prod, ${CONS} cons, ${ANNOY} annoy, ${b}\n"
+    ./prod_cons -P -B ${b} -p ${PROD} -c ${CONS} -a ${ANNOY} \
+      -d ${DURATION} \
+      > ${RESULTS_PATH}/learning_${b%%:*}_${PROD}prod_${CONS}cons_${ANNOY}annoy.txt
+    sleep 2
+done
+
+grep -H -A 2 "^uboost:" \
+  ${RESULTS_PATH}/learning_*_${PROD}prod_${CONS}cons_${ANNOY}annoy.txt
+grep -H "cond blocked\|context switches" \
+  ${RESULTS_PATH}/learning_*_${PROD}prod_${CONS}cons_${ANNOY}annoy.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
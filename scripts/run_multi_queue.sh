@@ -0,0 +1,25 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${3?"Usage: $0 DURATION RESULTS_PATH INTERVAL_USEC"}
+
+DURATION=$1
+RESULTS_PATH=$2
+INTERVAL=$3
+
+mkdir -p ${RESULTS_PATH}
+
+for k in 2 4 8 16 32 64; do
+    for m in waitv group threads poll; do
+        printf "${k} queues, ${m}\n"
+        ./mq_bench -m ${m} -k ${k} -i ${INTERVAL} -d ${DURATION} \
+          > ${RESULTS_PATH}/mq_${m}_${k}q.txt
+        sleep 2
+    done
+    grep -h -A4 "K=${k}:" ${RESULTS_PATH}/mq_*_${k}q.txt
+done
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${5?"Usage: $0 DURATION RESULTS_PATH PROD CONS ANNOY"}
+
+DURATION=$1
+RESULTS_PATH=$2
+PROD=$3
+CONS=$4
+ANNOY=$5
+
+mkdir -p ${RESULTS_PATH}
+
+for n in cond pi-cond futex eventfd; do
+    printf "${PROD} prod, ${CONS} cons, ${ANNOY} annoy, ${n} notifications\n"
+    ./prod_cons -N ${n} -p ${PROD} -c ${CONS} -a ${ANNOY} -d ${DURATION} \
+      > ${RESULTS_PATH}/notify_${n}_${PROD}prod_${CONS}cons_${ANNOY}annoy.txt
+    sleep 2
+done
+
+grep -H "wake latency\|syscalls" \
+  ${RESULTS_PATH}/notify_*_${PROD}prod_${CONS}cons_${ANNOY}annoy.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
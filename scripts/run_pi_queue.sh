@@ -0,0 +1,35 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${5?"Usage: $0 DURATION RESULTS_PATH WORK_NSEC PROD CONS"}
+
+DURATION=$1
+RESULTS_PATH=$2
+WORK=$3
+PROD=$4
+CONS=$5
+
+mkdir -p ${RESULTS_PATH}
+
+# mutex + condvars buffer against the libcv PI queue, throughput mode
+for b in pi futex uboost; do
+    for mode in buffer queue; do
+        q=""
+        if [ ${mode} == "queue" ]; then
+            q="-q"
+        fi
+        printf "${PROD} prod, ${CONS} cons, ${b}, ${mode}\n"
+        ./prod_cons -B ${b} ${q} -T ${WORK} -p ${PROD} -c ${CONS} -a 0 \
+          -d ${DURATION} \
+          > ${RESULTS_PATH}/pi_queue_${b}_${mode}_${PROD}prod_${CONS}cons.txt
+        sleep 2
+    done
+done
+
+grep -H "items/sec\|lock+item wait\|cond blocked\|futex syscalls" \
+  ${RESULTS_PATH}/pi_queue_*_${PROD}prod_${CONS}cons.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,34 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${4?"Usage: $0 DURATION RESULTS_PATH PROD CONS"}
+
+DURATION=$1
+RESULTS_PATH=$2
+PROD=$3
+CONS=$4
+
+mkdir -p ${RESULTS_PATH}
+
+# the same run with threads and with one process per thread (-F)
+for b in pi pi-cond futex; do
+    for mode in threads processes; do
+        f=""
+        if [ ${mode} == "processes" ]; then
+            f="-F"
+        fi
+        printf "${PROD} prod, ${CONS} cons, ${b}, ${mode}\n"
+        ./prod_cons -B ${b} ${f} -p ${PROD} -c ${CONS} -a 1 \
+          -S uniform:100,1000 -d ${DURATION} \
+          > ${RESULTS_PATH}/processes_${b}_${mode}_${PROD}prod_${CONS}cons.txt
+        sleep 2
+    done
+done
+
+grep -H "wake latency\|cond blocked\|items/sec" \
+  ${RESULTS_PATH}/processes_*_${PROD}prod_${CONS}cons.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
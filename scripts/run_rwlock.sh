@@ -0,0 +1,24 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${2?"Usage: $0 ITERATIONS RESULTS_PATH"}
+
+ITERATIONS=$1
+RESULTS_PATH=$2
+
+mkdir -p ${RESULTS_PATH}
+
+# unboosted readers, kernel helpers, userspace helpers
+for b in pi pi-cond uboost; do
+    printf "1..16 readers, ${b}\n"
+    ./pi_rwlock_stress -B ${b} -r 1,2,4,8,16 -i ${ITERATIONS} \
+      > ${RESULTS_PATH}/rwlock_${b}.txt
+    sleep 2
+done
+
+grep -H "readers,\|writer blocked" ${RESULTS_PATH}/rwlock_*.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,35 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${3?"Usage: $0 DURATION RESULTS_PATH WORK_NSEC"}
+
+DURATION=$1
+RESULTS_PATH=$2
+WORK=$3
+
+mkdir -p ${RESULTS_PATH}
+
+# park right away against spin then park (-w), on one CPU and across CPUs
+for b in pi futex; do
+    for l in one spread smt; do
+        for mode in park spin; do
+            w=""
+            if [ ${mode} == "spin" ]; then
+                w="-w"
+            fi
+            printf "${b}, ${l}, ${mode}\n"
+            ./prod_cons -B ${b} ${w} -L ${l} -T ${WORK} -p 1 -c 1 -a 0 \
+              -d ${DURATION} \
+              > ${RESULTS_PATH}/spin_${b}_${l}_${mode}.txt
+            sleep 2
+        done
+    done
+done
+
+grep -H "items/sec\|lock+item wait\|adaptive spin\|futex syscalls" \
+  ${RESULTS_PATH}/spin_*.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${5?"Usage: $0 DURATION RESULTS_PATH PROD CONS ANNOY"}
+
+DURATION=$1
+RESULTS_PATH=$2
+PROD=$3
+CONS=$4
+ANNOY=$5
+
+mkdir -p ${RESULTS_PATH}
+
+# every backend, with and without helpers where the backend leaves it to us
+for b in pi pi-cond protect spin futex; do
+  for p in "" -P; do
+    [[ -n "$p" && ( $b == pi || $b == pi-cond || $b == protect ) ]] && continue
+    name=${b}${p:+_helpers}
+    printf "${PROD} prod, ${CONS} cons, ${ANNOY} annoy, ${name}\n"
+    ./prod_cons -B ${b} ${p} -p ${PROD} -c ${CONS} -a ${ANNOY} \
+      -d ${DURATION} \
+      > ${RESULTS_PATH}/sync_${name}_${PROD}prod_${CONS}cons_${ANNOY}annoy.txt
+    sleep 2
+  done
+done
+
+grep -H "items/sec\|wake latency" \
+  ${RESULTS_PATH}/sync_*_${PROD}prod_${CONS}cons_${ANNOY}annoy.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
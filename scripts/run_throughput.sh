@@ -0,0 +1,31 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${5?"Usage: $0 DURATION RESULTS_PATH PROD CONS WORK_NSEC"}
+
+DURATION=$1
+RESULTS_PATH=$2
+PROD=$3
+CONS=$4
+WORK=$5
+
+mkdir -p ${RESULTS_PATH}
+
+# without PI-cond
+printf "${PROD} prod, ${CONS} cons, ${WORK} nsec work, without PI\n"
+./prod_cons -T ${WORK} -p ${PROD} -c ${CONS} -a 0 -d ${DURATION} \
+  > ${RESULTS_PATH}/tput_no_pi_${PROD}prod_${CONS}cons_${WORK}ns.txt
+
+sleep 2
+
+# with PI-cond
+printf "${PROD} prod, ${CONS} cons, ${WORK} nsec work, with PI\n"
+./prod_cons -P -T ${WORK} -p ${PROD} -c ${CONS} -a 0 -d ${DURATION} \
+  > ${RESULTS_PATH}/tput_pi_${PROD}prod_${CONS}cons_${WORK}ns.txt
+
+grep -H "items/sec\|futex" ${RESULTS_PATH}/tput_*pi_${PROD}prod_${CONS}cons_${WORK}ns.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${3?"Usage: $0 DURATION RESULTS_PATH WORK_NSEC"}
+
+DURATION=$1
+RESULTS_PATH=$2
+WORK=$3
+
+mkdir -p ${RESULTS_PATH}
+
+# consumers waiting with timeouts, producers doing their work pre-lock
+for b in pi pi-cond uboost; do
+    for t in 200 500 2000 10000; do
+        printf "${b}, timeout ${t}us\n"
+        ./prod_cons -B ${b} -p 1 -c 1 -a 0 -T ${WORK} -W 1:0:0 \
+          -t const:${t} -d ${DURATION} \
+          > ${RESULTS_PATH}/timed_${b}_${t}us.txt
+        sleep 2
+    done
+done
+
+grep -H "items/sec\|timeouts\|timeout overshoot\|wake latency\|timed waits" \
+  ${RESULTS_PATH}/timed_*.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
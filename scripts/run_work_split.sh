@@ -0,0 +1,38 @@
+#!/bin/bash
+# Make sure only root can run our script
+if [[ $EUID -ne 0 ]]; then
+  echo "This script must be run as root" 1>&2
+  exit 1
+fi
+: ${5?"Usage: $0 DURATION RESULTS_PATH PROD CONS ANNOY"}
+
+DURATION=$1
+RESULTS_PATH=$2
+PROD=$3
+CONS=$4
+ANNOY=$5
+
+mkdir -p ${RESULTS_PATH}
+
+# from everything inside the lock to publishing only
+for SPLIT in 0:1:0 1:2:1 1:1:1 2:1:2 4:1:4 9:1:9; do
+    NAME=${PROD}prod_${CONS}cons_${ANNOY}annoy_${SPLIT//:/-}
+
+    # without PI-cond
+    printf "${PROD} prod, ${CONS} cons, ${ANNOY} annoy, split ${SPLIT}, without PI\n"
+    ./prod_cons -W ${SPLIT} -p ${PROD} -c ${CONS} -a ${ANNOY} -d ${DURATION} \
+      > ${RESULTS_PATH}/split_no_pi_${NAME}.txt
+
+    sleep 2
+
+    # with PI-cond
+    printf "${PROD} prod, ${CONS} cons, ${ANNOY} annoy, split ${SPLIT}, with PI\n"
+    ./prod_cons -P -W ${SPLIT} -p ${PROD} -c ${CONS} -a ${ANNOY} -d ${DURATION} \
+      > ${RESULTS_PATH}/split_pi_${NAME}.txt
+
+    sleep 2
+done
+
+grep -H -A1 "^consumers\|^producers" ${RESULTS_PATH}/split_*pi_${PROD}prod_${CONS}cons_${ANNOY}annoy_*.txt
+
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
@@ -0,0 +1,103 @@
+/******************************************************************************
+* FILE: stats.c
+* DESCRIPTION:
+*  Log-linear latency histograms, see stats.h.
+******************************************************************************/
+#include <string.h>
+#include "stats.h"
+
+static inline int hist_index(unsigned long long v)
+{
+	int shift;
+
+	if (v < HIST_SUB)
+		return v;
+
+	shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+
+	return (shift + 1) * HIST_SUB + ((v >> shift) & (HIST_SUB - 1));
+}
+
+/* Largest value falling in bucket idx */
+static inline unsigned long long hist_value(int idx)
+{
+	int shift;
+
+	if (idx < HIST_SUB)
+		return idx;
+
+	shift = idx / HIST_SUB - 1;
+
+	return ((unsigned long long)(HIST_SUB + idx % HIST_SUB + 1) << shift) - 1;
+}
+
+void hist_init(hist_t *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = ~0ULL;
+}
+
+void hist_add(hist_t *h, unsigned long long v)
+{
+	h->count++;
+	h->sum += v;
+	if (v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->bucket[hist_index(v)]++;
+}
+
+void hist_merge(hist_t *dst, const hist_t *src)
+{
+	int i;
+
+	if (!src->count)
+		return;
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->bucket[i] += src->bucket[i];
+}
+
+unsigned long long hist_percentile(const hist_t *h, double p)
+{
+	unsigned long rank, seen = 0;
+	unsigned long long v;
+	int i;
+
+	if (!h->count)
+		return 0;
+
+	rank = (unsigned long)(p / 100.0 * h->count);
+	if (rank >= h->count)
+		rank = h->count - 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen > rank)
+			break;
+	}
+
+	v = hist_value(i);
+
+	return v > h->max ? h->max : v;
+}
+
+void hist_print(FILE *out, const char *name, const hist_t *h)
+{
+	if (!h->count) {
+		fprintf(out, "%-24s count 0\n", name);
+		return;
+	}
+
+	fprintf(out, "%-24s count %lu min %llu avg %llu p50 %llu p99 %llu"
+		" p99.9 %llu max %llu (nsec)\n", name, h->count, h->min,
+		h->sum / h->count, hist_percentile(h, 50.0),
+		hist_percentile(h, 99.0), hist_percentile(h, 99.9), h->max);
+}
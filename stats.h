@@ -0,0 +1,38 @@
+/******************************************************************************
+* FILE: stats.h
+* DESCRIPTION:
+*  Lock-free per-thread latency histograms.
+*
+*  Each thread updates its own hist_t; histograms are merged by the main
+*  thread when the run is over. Buckets are log-linear (HIST_SUB buckets per
+*  power of two), so the relative error of a percentile is below 1/HIST_SUB
+*  for any value up to 2^64 nsec.
+******************************************************************************/
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdio.h>
+
+#define HIST_SUB_BITS	4
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS	(64 * HIST_SUB)
+
+typedef struct _hist_t {
+	unsigned long count;
+	unsigned long long sum;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long bucket[HIST_BUCKETS];
+} hist_t;
+
+void hist_init(hist_t *h);
+
+void hist_add(hist_t *h, unsigned long long v);
+
+void hist_merge(hist_t *dst, const hist_t *src);
+
+unsigned long long hist_percentile(const hist_t *h, double p);
+
+void hist_print(FILE *out, const char *name, const hist_t *h);
+
+#endif /* _STATS_H_ */
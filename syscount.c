@@ -0,0 +1,77 @@
+/******************************************************************************
+* FILE: syscount.c
+* DESCRIPTION:
+*  Per-process system call counters, see syscount.h.
+******************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "syscount.h"
+
+static const char *tracefs_paths[] = {
+	"/debug/tracing",
+	"/sys/kernel/tracing",
+	"/sys/kernel/debug/tracing",
+	NULL
+};
+
+static long tracepoint_id(const char *syscall_name)
+{
+	char path[256];
+	long id = -1;
+	FILE *f;
+	int i;
+
+	for (i = 0; tracefs_paths[i]; i++) {
+		snprintf(path, sizeof(path),
+			 "%s/events/syscalls/sys_enter_%s/id",
+			 tracefs_paths[i], syscall_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fscanf(f, "%ld", &id) != 1)
+			id = -1;
+		fclose(f);
+		if (id >= 0)
+			break;
+	}
+
+	return id;
+}
+
+int syscount_open(const char *syscall_name)
+{
+	struct perf_event_attr attr;
+	long id;
+
+	id = tracepoint_id(syscall_name);
+	if (id < 0)
+		return -1;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_TRACEPOINT;
+	attr.config = id;
+	attr.inherit = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+long long syscount_read(int fd)
+{
+	long long count;
+
+	if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))
+		return -1;
+
+	return count;
+}
+
+void syscount_close(int fd)
+{
+	if (fd >= 0)
+		close(fd);
+}
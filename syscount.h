@@ -0,0 +1,23 @@
+/******************************************************************************
+* FILE: syscount.h
+* DESCRIPTION:
+*  Count system calls made by the whole process through the
+*  syscalls:sys_enter_<name> tracepoint and perf_event_open().
+*
+*  The counter is inherited by threads created after syscount_open(), and
+*  reading it returns the sum over all of them. It needs tracefs mounted
+*  (the /debug mount used by the ftrace options, or one of the standard
+*  locations) and enough privileges to use tracepoint events.
+******************************************************************************/
+#ifndef _SYSCOUNT_H_
+#define _SYSCOUNT_H_
+
+/* Returns a counter fd, or -1 if the tracepoint cannot be used */
+int syscount_open(const char *syscall_name);
+
+/* Current count, -1 if fd is not a valid counter */
+long long syscount_read(int fd);
+
+void syscount_close(int fd);
+
+#endif /* _SYSCOUNT_H_ */
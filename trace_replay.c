@@ -0,0 +1,308 @@
+/******************************************************************************
+* FILE: trace_replay.c
+* DESCRIPTION:
+*  Streamed trace reader, see trace_replay.h.
+******************************************************************************/
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace_replay.h"
+#include "rt-app_utils.h"
+
+/* In shared memory, before anybody forks */
+static int reader_init(trace_t *t)
+{
+	pthread_mutexattr_t mattr;
+	pthread_condattr_t cattr;
+	trace_reader_t *r;
+
+	t->reader_len = sizeof(*r) + t->nprod * sizeof(trace_ring_t);
+	r = mmap(NULL, t->reader_len, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (r == MAP_FAILED)
+		return 1;
+
+	/* producers are RT threads, whoever parses must not be preempted */
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&r->lock, &mattr);
+	pthread_mutexattr_destroy(&mattr);
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+	pthread_cond_init(&r->room, &cattr);
+	pthread_condattr_destroy(&cattr);
+
+	r->pos = t->binary ? TRACE_MAGIC_LEN : 0;
+	t->reader = r;
+
+	return 0;
+}
+
+int trace_open(const char *path, int nprod, trace_t *t)
+{
+	struct stat st;
+	void *base;
+	int fd;
+
+	memset(t, 0, sizeof(*t));
+	t->nprod = nprod;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		log_error("cannot open trace %s", path);
+		return 1;
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		log_error("cannot stat trace %s or trace is empty", path);
+		close(fd);
+		return 1;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		log_error("cannot map trace %s", path);
+		return 1;
+	}
+	madvise(base, st.st_size, MADV_SEQUENTIAL);
+	/* never keep trace pages locked (mlockall), they are streamed */
+	munlock(base, st.st_size);
+
+	t->base = base;
+	t->len = st.st_size;
+	t->binary = t->len >= TRACE_MAGIC_LEN &&
+		    memcmp(t->base, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0;
+
+	if (t->binary &&
+	    (t->len - TRACE_MAGIC_LEN) % sizeof(struct trace_rec) != 0) {
+		log_error("trace %s is truncated", path);
+		trace_close(t);
+		return 1;
+	}
+
+	if (nprod < 1 || reader_init(t)) {
+		log_error("cannot set up the reader of trace %s", path);
+		trace_close(t);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Producers killed while waiting for room (-F) would keep a condvar
+ * destroy waiting forever: unmapping is enough.
+ */
+void trace_close(trace_t *t)
+{
+	if (t->reader)
+		munmap(t->reader, t->reader_len);
+	if (t->base)
+		munmap((void *)t->base, t->len);
+	t->reader = NULL;
+	t->base = NULL;
+	t->len = 0;
+}
+
+void trace_cursor_init(trace_cursor_t *c, trace_t *t, int prod)
+{
+	c->trace = t;
+	c->prod = prod;
+}
+
+/*
+ * Called with the reader lock held. Release the pages the reader walked
+ * past: every record there was parsed, and is in a ring if it is not
+ * consumed yet, so no producer touches them again. Each process does it
+ * for its own mapping, when it parses.
+ */
+static void trace_drop_behind(trace_t *t)
+{
+	size_t end = t->reader->pos & ~(TRACE_DROP_CHUNK - 1);
+
+	if (end <= t->dropped)
+		return;
+
+	madvise((void *)(t->base + t->dropped), end - t->dropped,
+		MADV_DONTNEED);
+	t->dropped = end;
+}
+
+static int parse_u64(const char **p, const char *end, uint64_t *v)
+{
+	const char *s = *p;
+
+	while (s < end && (*s == ' ' || *s == '\t'))
+		s++;
+	if (s == end || *s < '0' || *s > '9')
+		return 1;
+
+	*v = 0;
+	while (s < end && *s >= '0' && *s <= '9')
+		*v = *v * 10 + (*s++ - '0');
+
+	while (s < end && (*s == ' ' || *s == '\t'))
+		s++;
+	*p = s;
+
+	return 0;
+}
+
+static int parse_csv(trace_t *t, struct trace_rec *rec)
+{
+	trace_reader_t *r = t->reader;
+	const char *base = t->base;
+	const char *end = base + t->len;
+	const char *p, *eol;
+	uint64_t arrival, service, producer;
+
+	while (r->pos < t->len) {
+		p = base + r->pos;
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		r->pos = eol - base + 1;
+		r->line++;
+
+		if (p == eol || *p == '#' || *p == '\r')
+			continue;
+
+		if (parse_u64(&p, eol, &arrival) || p == eol || *p++ != ',' ||
+		    parse_u64(&p, eol, &service) || p == eol || *p++ != ',' ||
+		    parse_u64(&p, eol, &producer)) {
+			log_error("malformed trace record at line %lu",
+				  r->line);
+			return -1;
+		}
+
+		rec->arrival = arrival;
+		rec->service = service;
+		rec->producer = producer;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Called with the reader lock held */
+static int parse_next(trace_t *t, struct trace_rec *rec)
+{
+	trace_reader_t *r = t->reader;
+
+	if (!t->binary)
+		return parse_csv(t, rec);
+
+	if (r->pos >= t->len)
+		return 0;
+	memcpy(rec, t->base + r->pos, sizeof(*rec));
+	r->pos += sizeof(*rec);
+
+	return 1;
+}
+
+/* Called with the reader lock held, 0 if the ring is full */
+static int ring_push(trace_ring_t *q, const struct trace_rec *rec)
+{
+	if (q->head - __atomic_load_n(&q->tail, __ATOMIC_SEQ_CST) ==
+	    TRACE_RING)
+		return 0;
+
+	q->rec[q->head % TRACE_RING] = *rec;
+	__atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/* By the ring's producer only, with or without the lock */
+static int ring_pop(trace_ring_t *q, struct trace_rec *rec)
+{
+	if (q->tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+		return 0;
+
+	*rec = q->rec[q->tail % TRACE_RING];
+	/* pairs with the waiting count in reader_fill() */
+	__atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_SEQ_CST);
+
+	return 1;
+}
+
+/*
+ * Called with the reader lock held, our ring is empty: parse on until a
+ * record of ours comes up. The record in hand stays in the reader while
+ * its ring is full, so that whoever parses next hands it over first and
+ * every ring gets its records in trace order.
+ */
+static int reader_fill(trace_cursor_t *c, struct trace_rec *rec)
+{
+	trace_t *t = c->trace;
+	trace_reader_t *r = t->reader;
+	trace_ring_t *q;
+	int ret, owner;
+
+	for (;;) {
+		/* somebody parsed ours while we waited */
+		if (ring_pop(&r->rings[c->prod], rec)) {
+			if (r->waiting)
+				pthread_cond_broadcast(&r->room);
+			return 1;
+		}
+
+		if (r->pending) {
+			owner = r->rec.producer % t->nprod;
+			if (owner == c->prod) {
+				*rec = r->rec;
+				r->pending = 0;
+				return 1;
+			}
+			q = &r->rings[owner];
+			if (ring_push(q, &r->rec)) {
+				r->pending = 0;
+				continue;
+			}
+			/* its producer is behind, wait for it to take one */
+			__atomic_add_fetch(&r->waiting, 1, __ATOMIC_SEQ_CST);
+			if (q->head - __atomic_load_n(&q->tail,
+						      __ATOMIC_SEQ_CST) ==
+			    TRACE_RING)
+				pthread_cond_wait(&r->room, &r->lock);
+			__atomic_sub_fetch(&r->waiting, 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+
+		if (r->done)
+			return r->done > 0 ? 0 : -1;
+		ret = parse_next(t, &r->rec);
+		trace_drop_behind(t);
+		if (ret <= 0)
+			r->done = ret < 0 ? -1 : 1;
+		else
+			r->pending = 1;
+	}
+}
+
+int trace_next(trace_cursor_t *c, struct trace_rec *rec)
+{
+	trace_reader_t *r = c->trace->reader;
+	int ret;
+
+	/* the common case, no lock */
+	if (ring_pop(&r->rings[c->prod], rec)) {
+		if (__atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST)) {
+			pthread_mutex_lock(&r->lock);
+			pthread_cond_broadcast(&r->room);
+			pthread_mutex_unlock(&r->lock);
+		}
+		return 1;
+	}
+
+	pthread_mutex_lock(&r->lock);
+	ret = reader_fill(c, rec);
+	pthread_mutex_unlock(&r->lock);
+
+	return ret;
+}
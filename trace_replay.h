@@ -0,0 +1,93 @@
+/******************************************************************************
+* FILE: trace_replay.h
+* DESCRIPTION:
+*  Memory-mapped, streamed reader for recorded (arrival offset, service time,
+*  producer id) traces.
+*
+*  Two formats are accepted:
+*   - binary: the 8 byte TRACE_MAGIC followed by packed struct trace_rec
+*     records;
+*   - CSV: one "arrival,service,producer" line per record, '#' starts a
+*     comment line.
+*  Times are in usec, arrivals are offsets from the start of the replay.
+*
+*  The file is never read into memory as a whole: it is mapped read-only
+*  with sequential access advice, and pages the reader has walked past are
+*  dropped every TRACE_DROP_CHUNK bytes, so the resident set stays bounded
+*  for multi-GB traces.
+*
+*  The trace is parsed once, whatever the number of producers: a producer
+*  whose ring is empty takes the reader lock and parses on, handing the
+*  records of the others to their rings of TRACE_RING records, until it
+*  finds one of its own; it waits for room if a ring is full. The reader
+*  state is in shared memory, so producers forked after trace_open() share
+*  it too; each of them drops the pages behind the reader in its own
+*  mapping, which nobody reads again.
+******************************************************************************/
+#ifndef _TRACE_REPLAY_H_
+#define _TRACE_REPLAY_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define TRACE_MAGIC		"PCTRACE1"
+#define TRACE_MAGIC_LEN		8
+#define TRACE_DROP_CHUNK	(32UL << 20)
+#define TRACE_RING		1024	/* records, a power of 2 */
+
+struct trace_rec {
+	uint64_t arrival;
+	uint32_t service;
+	uint32_t producer;
+} __attribute__((packed));
+
+/* Records parsed for a producer, filled under the lock, emptied by it */
+typedef struct _trace_ring_t {
+	unsigned int head;
+	unsigned int tail;
+	struct trace_rec rec[TRACE_RING];
+} trace_ring_t;
+
+/* Shared by every producer, thread or process */
+typedef struct _trace_reader_t {
+	pthread_mutex_t lock;
+	pthread_cond_t room;		/* a ring got emptier */
+	int waiting;			/* parsers waiting for room */
+	size_t pos;			/* parsing position */
+	unsigned long line;
+	int done;			/* 1 end of trace, -1 malformed */
+	int pending;			/* rec not handed over yet, ... */
+	struct trace_rec rec;		/* ... its ring was full */
+	trace_ring_t rings[];		/* one per producer */
+} trace_reader_t;
+
+typedef struct _trace_t {
+	const char *base;
+	size_t len;
+	int binary;
+	int nprod;
+	trace_reader_t *reader;
+	size_t reader_len;
+	size_t dropped;			/* in our own mapping */
+} trace_t;
+
+typedef struct _trace_cursor_t {
+	trace_t *trace;
+	int prod;
+} trace_cursor_t;
+
+/* Records go to producer (record producer id modulo nprod) */
+int trace_open(const char *path, int nprod, trace_t *t);
+
+void trace_close(trace_t *t);
+
+void trace_cursor_init(trace_cursor_t *c, trace_t *t, int prod);
+
+/*
+ * Fetch the next record of the cursor's producer. Returns 1 if a record
+ * was read, 0 at end of trace, -1 on a malformed record.
+ */
+int trace_next(trace_cursor_t *c, struct trace_rec *rec);
+
+#endif /* _TRACE_REPLAY_H_ */